@@ -0,0 +1,617 @@
+/* Benchmark of find_font.
+
+Generates a set of synthetic fontconfig cache files (version 9, le64) in a
+temporary directory, loads them with ff_load_font_cache_from_dirs and times
+loading, exact, vague, batch and coverage lookups, iteration, bulk export,
+refreshing and unloading.
+The numbers only depend on the arguments, not on the fonts installed.
+
+usage: bench_find_font [patterns] [files] [iterations]
+
+defaults are 10000 patterns in 500 files, 10 iterations.
+Every family has BENCH_STYLES_PER_FAMILY styles.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shl/defer.hpp"
+#include "shl/print.hpp"
+#include "shl/platform.hpp"
+#include "shl/number_types.hpp"
+#include "shl/time.hpp"
+
+#include "window/find_font.hpp"
+
+#if Linux
+#include <unistd.h>
+#include <fcntl.h>
+#include <stddef.h>
+
+#define BENCH_DEFAULT_PATTERNS   10000
+#define BENCH_DEFAULT_FILES      500
+#define BENCH_DEFAULT_ITERATIONS 10
+#define BENCH_STYLES_PER_FAMILY  4
+
+static const char *_bench_styles[] = {
+    "Regular",
+    "Bold",
+    "Italic",
+    "Bold Italic",
+    "Light",
+    "Medium",
+    "Condensed",
+    "Black"
+};
+
+/* The layouts of the fontconfig cache structures on a 64 bit little endian
+machine, see FONTCONFIG DOCUMENTATION in find_font.cpp.
+All offsets except fontset_offset are "encoded" like fontconfig does it,
+i.e. (offset | 1), and relative to the structure that contains them
+(value offsets are relative to the value).
+*/
+struct bench_fc_cache
+{
+    u32 magic;
+    s32 version;
+    s64 filesize;
+    s64 dir_name_offset;
+    s64 subdir_offset;
+    s32 subdir_count;
+    s64 fontset_offset;
+    s32 checksum;
+    s64 checksum_nano;
+};
+
+struct bench_fc_fontset
+{
+    s32 pattern_count;
+    s32 sfont;
+    s64 patterns_offset;
+};
+
+struct bench_fc_pattern
+{
+    s32 elts_count;
+    s32 size;
+    s64 elts_offset;
+    s32 ref;
+};
+
+struct bench_fc_elt
+{
+    s32 object_id;
+    s64 value_list_offset;
+};
+
+struct bench_fc_value
+{
+    s32 type;
+    s64 value;
+};
+
+struct bench_fc_value_list
+{
+    s64 next_offset;
+    bench_fc_value value;
+    s32 binding;
+};
+
+// leaf offsets are relative to the start of the leaf offsets
+struct bench_fc_charset
+{
+    s32 ref;
+    s32 num;
+    s64 leaves_offset;
+    s64 numbers_offset;
+};
+
+struct bench_fc_charleaf
+{
+    u32 map[8];
+};
+
+#define BENCH_FC_CACHE_MAGIC_ALLOC 0xFC02FC05
+#define BENCH_FC_CACHE_VERSION     9
+#define BENCH_FC_TYPE_STRING       3
+#define BENCH_FC_TYPE_CHARSET      6
+#define BENCH_FC_FAMILY_OBJECT     1
+#define BENCH_FC_STYLE_OBJECT      3
+#define BENCH_FC_FILE_OBJECT       21
+#define BENCH_FC_CHARSET_OBJECT    33
+#define BENCH_NAME_SIZE            128
+
+// every font covers printable ASCII, Latin-1 and Latin Extended-A (pages 0
+// and 1), plus one CJK page that depends on the family.
+#define BENCH_CHARSET_PAGES        3
+#define BENCH_CJK_FIRST_PAGE       0x4e
+#define BENCH_CJK_PAGES            0x50
+
+struct bench_settings
+{
+    int patterns;
+    int files;
+    int iterations;
+};
+
+static void _bench_family_name(char *out, int family)
+{
+    snprintf(out, BENCH_NAME_SIZE, "Bench Family %05d", family);
+}
+
+static const char *_bench_style_name(int style)
+{
+    return _bench_styles[style % (int)(sizeof(_bench_styles) / sizeof(_bench_styles[0]))];
+}
+
+static void _bench_font_path(char *out, int family, int style)
+{
+    snprintf(out, BENCH_NAME_SIZE, "/usr/share/fonts/bench/BenchFamily%05d-%d.ttf", family, style);
+}
+
+static inline s64 _bench_reserve(s64 *at, s64 size)
+{
+    s64 ret = (*at + 7) & ~(s64)7;
+    *at = ret + size;
+    return ret;
+}
+
+static u32 _bench_cjk_page(int family)
+{
+    return BENCH_CJK_FIRST_PAGE + (u32)(family % BENCH_CJK_PAGES);
+}
+
+// reserves and writes the charset of a font of family, returns its offset.
+static s64 _bench_write_charset(char *buf, s64 *at, int family)
+{
+    s64 charset_offset = _bench_reserve(at, sizeof(bench_fc_charset));
+    s64 leaves_offset = _bench_reserve(at, BENCH_CHARSET_PAGES * sizeof(s64));
+    s64 numbers_offset = _bench_reserve(at, BENCH_CHARSET_PAGES * sizeof(u16));
+
+    bench_fc_charset *cs = (bench_fc_charset*)(buf + charset_offset);
+    cs->ref = -1;
+    cs->num = BENCH_CHARSET_PAGES;
+    cs->leaves_offset = (leaves_offset - charset_offset) | 1;
+    cs->numbers_offset = (numbers_offset - charset_offset) | 1;
+
+    const u16 numbers[BENCH_CHARSET_PAGES] = {0, 1, (u16)_bench_cjk_page(family)};
+
+    for (int i = 0; i < BENCH_CHARSET_PAGES; ++i)
+    {
+        s64 leaf_offset = _bench_reserve(at, sizeof(bench_fc_charleaf));
+        bench_fc_charleaf *leaf = (bench_fc_charleaf*)(buf + leaf_offset);
+
+        if (i == 0)
+        {
+            // U+0020 - U+007E, U+00A0 - U+00FF
+            leaf->map[1] = 0xffffffff;
+            leaf->map[2] = 0xffffffff;
+            leaf->map[3] = 0x7fffffff;
+            leaf->map[5] = 0xffffffff;
+            leaf->map[6] = 0xffffffff;
+            leaf->map[7] = 0xffffffff;
+        }
+        else
+            memset(leaf->map, 0xff, sizeof(leaf->map));
+
+        ((s64*)(buf + leaves_offset))[i] = (leaf_offset - leaves_offset) | 1;
+        ((u16*)(buf + numbers_offset))[i] = numbers[i];
+    }
+
+    return charset_offset;
+}
+
+// writes the patterns [first, first + count) into a single cache file.
+static bool _bench_write_cache_file(const char *path, int first, int count)
+{
+    // worst case size, strings are at most BENCH_NAME_SIZE each
+    s64 capacity = 256 + (s64)count * (8 + sizeof(bench_fc_pattern) + 4 * sizeof(bench_fc_elt)
+                                       + 4 * sizeof(bench_fc_value_list) + 3 * BENCH_NAME_SIZE
+                                       + sizeof(bench_fc_charset)
+                                       + BENCH_CHARSET_PAGES * (sizeof(s64) + sizeof(u16) + sizeof(bench_fc_charleaf))
+                                       + 128);
+    char *buf = (char*)calloc(1, (size_t)capacity);
+
+    if (buf == nullptr)
+        return false;
+
+    defer { ::free(buf); };
+
+    s64 at = 0;
+    s64 cache_offset = _bench_reserve(&at, sizeof(bench_fc_cache));
+    s64 fontset_offset = _bench_reserve(&at, sizeof(bench_fc_fontset));
+    s64 patterns_offset = _bench_reserve(&at, sizeof(s64) * count);
+
+    bench_fc_fontset *fs = (bench_fc_fontset*)(buf + fontset_offset);
+    fs->pattern_count = count;
+    fs->sfont = count;
+    fs->patterns_offset = (patterns_offset - fontset_offset) | 1;
+
+    char name[BENCH_NAME_SIZE];
+    char font_path[BENCH_NAME_SIZE];
+    const int object_ids[4] = {BENCH_FC_FAMILY_OBJECT, BENCH_FC_STYLE_OBJECT, BENCH_FC_FILE_OBJECT, BENCH_FC_CHARSET_OBJECT};
+
+    for (int i = 0; i < count; ++i)
+    {
+        int p = first + i;
+        int family = p / BENCH_STYLES_PER_FAMILY;
+        int style = p % BENCH_STYLES_PER_FAMILY;
+
+        _bench_family_name(name, family);
+        _bench_font_path(font_path, family, style);
+        const char *strings[3] = {name, _bench_style_name(style), font_path};
+
+        s64 pattern_offset = _bench_reserve(&at, sizeof(bench_fc_pattern));
+        s64 elts_offset = _bench_reserve(&at, 4 * sizeof(bench_fc_elt));
+
+        ((s64*)(buf + patterns_offset))[i] = (pattern_offset - fontset_offset) | 1;
+
+        bench_fc_pattern *pat = (bench_fc_pattern*)(buf + pattern_offset);
+        pat->elts_count = 4;
+        pat->size = 4;
+        pat->elts_offset = (elts_offset - pattern_offset) | 1;
+        pat->ref = -1;
+
+        // elts are sorted by object id
+        for (int e = 0; e < 4; ++e)
+        {
+            s64 elt_offset = elts_offset + e * (s64)sizeof(bench_fc_elt);
+            s64 list_offset = _bench_reserve(&at, sizeof(bench_fc_value_list));
+            s64 target_offset = 0;
+
+            if (object_ids[e] == BENCH_FC_CHARSET_OBJECT)
+                target_offset = _bench_write_charset(buf, &at, family);
+            else
+            {
+                s64 str_size = (s64)strlen(strings[e]) + 1;
+                target_offset = _bench_reserve(&at, str_size);
+                memcpy(buf + target_offset, strings[e], (size_t)str_size);
+            }
+
+            bench_fc_elt *elt = (bench_fc_elt*)(buf + elt_offset);
+            elt->object_id = object_ids[e];
+            elt->value_list_offset = (list_offset - elt_offset) | 1;
+
+            bench_fc_value_list *list = (bench_fc_value_list*)(buf + list_offset);
+            s64 value_offset = list_offset + (s64)offsetof(bench_fc_value_list, value);
+            list->next_offset = 0;
+            list->value.type = object_ids[e] == BENCH_FC_CHARSET_OBJECT ? BENCH_FC_TYPE_CHARSET : BENCH_FC_TYPE_STRING;
+            list->value.value = (target_offset - value_offset) | 1;
+            list->binding = 0;
+        }
+    }
+
+    s64 size = (at + 7) & ~(s64)7;
+
+    bench_fc_cache *cache = (bench_fc_cache*)(buf + cache_offset);
+    cache->magic = BENCH_FC_CACHE_MAGIC_ALLOC;
+    cache->version = BENCH_FC_CACHE_VERSION;
+    cache->filesize = size;
+    cache->fontset_offset = fontset_offset;
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+        return false;
+
+    bool ok = write(fd, buf, (size_t)size) == (ssize_t)size;
+    close(fd);
+
+    return ok;
+}
+
+static void _bench_cache_file_path(char *out, s64 out_size, const char *dir, int file)
+{
+    snprintf(out, (size_t)out_size, "%s/%032d-le64.cache-9", dir, file);
+}
+
+static bool _bench_generate(const char *dir, const bench_settings *settings)
+{
+    char path[512];
+
+    for (int f = 0; f < settings->files; ++f)
+    {
+        int first = (int)((s64)settings->patterns * f / settings->files);
+        int last  = (int)((s64)settings->patterns * (f + 1) / settings->files);
+
+        _bench_cache_file_path(path, sizeof(path), dir, f);
+
+        if (!_bench_write_cache_file(path, first, last - first))
+        {
+            tprint("Error: could not write %\n", (const char*)path);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void _bench_cleanup(const char *dir, const bench_settings *settings)
+{
+    char path[512];
+
+    for (int f = 0; f < settings->files; ++f)
+    {
+        _bench_cache_file_path(path, sizeof(path), dir, f);
+        unlink(path);
+    }
+
+    rmdir(dir);
+}
+
+struct bench_timer
+{
+    const char *name;
+    double total;
+    double min;
+    s64 runs;
+    s64 ops_per_run;
+};
+
+static void _bench_add(bench_timer *t, const timespan *start, const timespan *end)
+{
+    double secs = get_seconds_difference(start, end);
+
+    if (t->runs == 0 || secs < t->min)
+        t->min = secs;
+
+    t->total += secs;
+    t->runs += 1;
+}
+
+static void _bench_print(const bench_timer *t)
+{
+    if (t->runs == 0)
+        return;
+
+    double avg = t->total / (double)t->runs;
+
+    if (t->ops_per_run > 1)
+        tprint("  %: avg % ms, min % ms, % ns/op\n",
+               t->name, avg * 1000.0, t->min * 1000.0, avg * 1e9 / (double)t->ops_per_run);
+    else
+        tprint("  %: avg % ms, min % ms\n",
+               t->name, avg * 1000.0, t->min * 1000.0);
+}
+
+static void _bench_visit_family(const char *font, const char **styles, const char **paths, int style_count, void *userdata)
+{
+    (void)font;
+    (void)styles;
+    (void)paths;
+    *(s64*)userdata += style_count;
+}
+
+static int _bench_run(const char *dir, const bench_settings *settings)
+{
+    int family_count = (settings->patterns + BENCH_STYLES_PER_FAMILY - 1) / BENCH_STYLES_PER_FAMILY;
+    int query_count = settings->patterns;
+
+    // name, style pairs of every pattern, in a shuffled but fixed order
+    char *names = (char*)calloc((size_t)family_count, BENCH_NAME_SIZE);
+    char *prefixes = (char*)calloc((size_t)family_count, BENCH_NAME_SIZE);
+    const char **queries = (const char**)calloc((size_t)query_count * 2, sizeof(const char*));
+    const char **vague_queries = (const char**)calloc((size_t)query_count * 2, sizeof(const char*));
+    const char **out_paths = (const char**)calloc((size_t)query_count, sizeof(const char*));
+    ff_query *precomputed = (ff_query*)calloc((size_t)query_count, sizeof(ff_query));
+    const char **export_fonts = (const char**)calloc((size_t)settings->patterns, sizeof(const char*));
+    const char **export_styles = (const char**)calloc((size_t)settings->patterns, sizeof(const char*));
+    const char **export_paths = (const char**)calloc((size_t)settings->patterns, sizeof(const char*));
+
+    defer
+    {
+        ::free(names);
+        ::free(prefixes);
+        ::free(queries);
+        ::free(vague_queries);
+        ::free(out_paths);
+        ::free(precomputed);
+        ::free(export_fonts);
+        ::free(export_styles);
+        ::free(export_paths);
+    };
+
+    for (int f = 0; f < family_count; ++f)
+    {
+        _bench_family_name(names + f * BENCH_NAME_SIZE, f);
+
+        // drop the last digit, so vague lookups match up to 10 families
+        memcpy(prefixes + f * BENCH_NAME_SIZE, names + f * BENCH_NAME_SIZE, BENCH_NAME_SIZE);
+        prefixes[f * BENCH_NAME_SIZE + strlen(names + f * BENCH_NAME_SIZE) - 1] = '\0';
+    }
+
+    u32 rng = 0x9e3779b9;
+
+    for (int q = 0; q < query_count; ++q)
+    {
+        // xorshift, fixed seed
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+
+        int p = (int)(rng % (u32)settings->patterns);
+        int family = p / BENCH_STYLES_PER_FAMILY;
+        int style = p % BENCH_STYLES_PER_FAMILY;
+
+        queries[q * 2]     = names + family * BENCH_NAME_SIZE;
+        queries[q * 2 + 1] = _bench_style_name(style);
+        vague_queries[q * 2]     = prefixes + family * BENCH_NAME_SIZE;
+        vague_queries[q * 2 + 1] = "Bol";
+        precomputed[q] = ff_make_query(queries[q * 2], queries[q * 2 + 1]);
+    }
+
+    const char *cache_dirs[] = {dir};
+
+    bench_timer t_load    = {"load", 0, 0, 0, 1};
+    bench_timer t_exact   = {"exact lookup", 0, 0, 0, query_count};
+    bench_timer t_vague   = {"vague lookup", 0, 0, 0, query_count};
+    bench_timer t_batch   = {"batch lookup", 0, 0, 0, query_count};
+    bench_timer t_first   = {"first font path", 0, 0, 0, query_count};
+    bench_timer t_precomputed = {"precomputed first", 0, 0, 0, query_count};
+    bench_timer t_covering = {"covering lookup", 0, 0, 0, query_count};
+    bench_timer t_iterate = {"iterate", 0, 0, 0, settings->patterns};
+    bench_timer t_export  = {"export", 0, 0, 0, settings->patterns};
+    bench_timer t_visit   = {"visit families", 0, 0, 0, settings->patterns};
+    bench_timer t_refresh = {"refresh (no-op)", 0, 0, 0, 1};
+    bench_timer t_unload  = {"unload", 0, 0, 0, 1};
+
+    s64 found = 0;
+    s64 iterated = 0;
+    ff_cache_stats stats{};
+    timespan start;
+    timespan end;
+
+    for (int it = 0; it < settings->iterations; ++it)
+    {
+        get_time(&start);
+        ff_cache *cache = ff_load_font_cache_from_dirs(cache_dirs, 1);
+        get_time(&end);
+
+        if (cache == nullptr)
+        {
+            tprint("Error: could not load the generated cache files\n");
+            return 1;
+        }
+
+        _bench_add(&t_load, &start, &end);
+        ff_cache_get_stats(cache, &stats);
+
+        get_time(&start);
+        for (int q = 0; q < query_count; ++q)
+            found += ff_find_font_path(cache, queries[q * 2], queries[q * 2 + 1]) != nullptr;
+        get_time(&end);
+        _bench_add(&t_exact, &start, &end);
+
+        get_time(&start);
+        for (int q = 0; q < query_count; ++q)
+            found += ff_find_font_path_vague(cache, vague_queries[q * 2], vague_queries[q * 2 + 1]) != nullptr;
+        get_time(&end);
+        _bench_add(&t_vague, &start, &end);
+
+        get_time(&start);
+        found += ff_find_font_paths_batch(cache, queries, query_count * 2, out_paths);
+        get_time(&end);
+        _bench_add(&t_batch, &start, &end);
+
+        get_time(&start);
+        for (int q = 0; q < query_count; ++q)
+            found += ff_find_first_font_path(cache, queries + q * 2, 2, nullptr) != nullptr;
+        get_time(&end);
+        _bench_add(&t_first, &start, &end);
+
+        get_time(&start);
+        for (int q = 0; q < query_count; ++q)
+            found += ff_find_first_font_path_precomputed(cache, precomputed + q, 1, nullptr) != nullptr;
+        get_time(&end);
+        _bench_add(&t_precomputed, &start, &end);
+
+        get_time(&start);
+        for (int q = 0; q < query_count; ++q)
+        {
+            // alternates between a page every font has and a CJK page
+            u32 codepoint = (q & 1) ? (_bench_cjk_page(q) << 8) | (u32)(q & 0xff) : 0x20 + (u32)(q % 0x5f);
+            found += ff_find_font_covering(cache, codepoint, queries[q * 2 + 1]) != nullptr;
+        }
+        get_time(&end);
+        _bench_add(&t_covering, &start, &end);
+
+        get_time(&start);
+        for_font_cache(font, style, path, cache)
+            iterated += 1;
+        get_time(&end);
+        _bench_add(&t_iterate, &start, &end);
+
+        get_time(&start);
+        iterated += ff_cache_export(cache, export_fonts, export_styles, export_paths, settings->patterns);
+        get_time(&end);
+        _bench_add(&t_export, &start, &end);
+
+        get_time(&start);
+        ff_cache_visit_families(cache, _bench_visit_family, &iterated);
+        get_time(&end);
+        _bench_add(&t_visit, &start, &end);
+
+        get_time(&start);
+        ff_cache_refresh(cache);
+        get_time(&end);
+        _bench_add(&t_refresh, &start, &end);
+
+        get_time(&start);
+        ff_unload_font_cache(cache);
+        get_time(&end);
+        _bench_add(&t_unload, &start, &end);
+    }
+
+    tprint("find_font: % patterns, % families, % files, % iterations\n",
+           settings->patterns, family_count, settings->files, settings->iterations);
+
+    _bench_print(&t_load);
+    _bench_print(&t_exact);
+    _bench_print(&t_vague);
+    _bench_print(&t_batch);
+    _bench_print(&t_first);
+    _bench_print(&t_precomputed);
+    _bench_print(&t_covering);
+    _bench_print(&t_iterate);
+    _bench_print(&t_export);
+    _bench_print(&t_visit);
+    _bench_print(&t_refresh);
+    _bench_print(&t_unload);
+
+    tprint("  (found %, iterated %)\n", found, iterated);
+    tprint("last load: scan % ms, parse % ms, insert % ms, build % ms\n",
+           stats.scan_seconds * 1000.0, stats.parse_seconds * 1000.0,
+           stats.insert_seconds * 1000.0, stats.build_seconds * 1000.0);
+    tprint("  % bytes read, % bytes allocated, % bytes image\n",
+           stats.bytes_read, stats.bytes_allocated, stats.image_bytes);
+
+    return 0;
+}
+
+static int _parse_int_arg(const char *arg, int fallback)
+{
+    char *end = nullptr;
+    long ret = strtol(arg, &end, 10);
+
+    if (end == arg || *end != '\0' || ret <= 0 || ret > 100000000)
+        return fallback;
+
+    return (int)ret;
+}
+
+int main(int argc, const char *argv[])
+{
+    bench_settings settings{};
+    settings.patterns   = argc > 1 ? _parse_int_arg(argv[1], BENCH_DEFAULT_PATTERNS)   : BENCH_DEFAULT_PATTERNS;
+    settings.files      = argc > 2 ? _parse_int_arg(argv[2], BENCH_DEFAULT_FILES)      : BENCH_DEFAULT_FILES;
+    settings.iterations = argc > 3 ? _parse_int_arg(argv[3], BENCH_DEFAULT_ITERATIONS) : BENCH_DEFAULT_ITERATIONS;
+
+    if (settings.files > settings.patterns)
+        settings.files = settings.patterns;
+
+    char dir[] = "/tmp/bench_find_font.XXXXXX";
+
+    if (mkdtemp(dir) == nullptr)
+    {
+        tprint("Error: could not create a temporary directory\n");
+        return 1;
+    }
+
+    defer { _bench_cleanup(dir, &settings); };
+
+    if (!_bench_generate(dir, &settings))
+        return 1;
+
+    return _bench_run(dir, &settings);
+}
+#else
+int main(int argc, const char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    tprint("bench_find_font reads fontconfig caches and only runs on Linux\n");
+    return 0;
+}
+#endif
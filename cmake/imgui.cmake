@@ -21,6 +21,8 @@ set(imgui_SOURCES
     "${imgui_SOURCES_DIR}/imgui_tables.cpp"
 
     "${imgui_SOURCES_DIR}/backends/imgui_impl_opengl3.cpp"
+
+    "${CMAKE_CURRENT_SOURCE_DIR}/cmake/imgui_config.cpp"
 )
 
     list(APPEND imgui_SOURCES "${imgui_SOURCES_DIR}/imgui_demo.cpp")
@@ -36,4 +38,7 @@ add_library(imgui STATIC)
 target_sources(imgui PRIVATE ${imgui_SOURCES})
 target_include_directories(imgui PRIVATE ${imgui_INCLUDE_DIRS})
 
+# everything including imgui.h has to see the same configuration
+target_compile_definitions(imgui PUBLIC IMGUI_USER_CONFIG="${CMAKE_CURRENT_SOURCE_DIR}/cmake/imgui_config.hpp")
+
 set(imgui_LIBRARIES imgui)
@@ -0,0 +1,4 @@
+#include "imgui.h"
+
+// GImGui, see imgui_config.hpp
+thread_local ImGuiContext *imgui_current_context = nullptr;
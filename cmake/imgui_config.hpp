@@ -0,0 +1,16 @@
+#pragma once
+
+/* ImGui configuration
+
+IMGUI_USER_CONFIG of imgui and everything that includes imgui.h, see
+imgui.cmake.
+
+The current ImGui context is per thread (GImGui is thread_local): the render
+thread of every window of a pipelined loop draws with the context of its
+window, while the UI thread switches between the contexts of all windows.
+A new thread has no current context. Defined in imgui_config.cpp, which is
+part of the imgui library.
+*/
+struct ImGuiContext;
+extern thread_local ImGuiContext *imgui_current_context;
+#define GImGui imgui_current_context
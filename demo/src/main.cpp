@@ -6,6 +6,8 @@
 #include "window/find_font.hpp"
 #include "window/find_font_fonts.hpp"
 #include "window/window_imgui_util.hpp"
+#include "window/imgui_fonts.hpp"
+#include "backends/imgui_impl_opengl3.h"
 
 #include "ui/filepicker.hpp"
 
@@ -13,6 +15,8 @@
 
 static ImFont *ui_font = nullptr;
 static ImFont *monospace_font = nullptr;
+static ff_cache_load *font_cache_load = nullptr;
+static ff_cache *font_cache = nullptr;
 const float font_size   = 20.f;
 const int window_width  = 1600;
 const int window_height = 900;
@@ -34,11 +38,16 @@ static void _template_settings_window()
     ImGui::End();
 }
 
+static void _load_imgui_fonts();
+
 static void _update(GLFWwindow *window, double dt)
 {
-    (void)window;
     (void)dt;
 
+    // fonts have to be added before the frame starts
+    if (font_cache_load != nullptr && ff_cache_load_done(font_cache_load))
+        _load_imgui_fonts();
+
     imgui_new_frame();
 
     _template_settings_window();
@@ -92,6 +101,7 @@ static void _update(GLFWwindow *window, double dt)
     ImGui::End();
 
     ImGui::ShowDemoWindow();
+    imgui_frame_stats_overlay(window);
 
     imgui_end_frame();
 }
@@ -100,23 +110,35 @@ static void _update(GLFWwindow *window, double dt)
 
 static void _load_imgui_fonts()
 {
-    ff_cache *fc = ff_load_font_cache();
-    defer { ff_unload_font_cache(fc); };
+    // kept loaded for glyphs the fonts don't have, see imgui_set_glyph_fallback_cache
+    ff_cache *fc = ff_cache_load_wait(font_cache_load);
+    font_cache_load = nullptr;
+    font_cache = fc;
 
     for_font_cache(f, s, p, fc)
     {
         tprint("%; %; %\n", f, s, p);
     }
 
-    const char *ui_font_path = ff_find_first_font_path(fc, (const char**)font_names_ui, font_names_ui_count * 2, nullptr);
-    const char *monospace_font_path = ff_find_first_font_path(fc, (const char**)font_names_monospace, font_names_monospace_count * 2, nullptr);
+    const char *ui_font_path = ff_find_first_font_path_precomputed(fc, font_queries_ui);
+    const char *monospace_font_path = ff_find_first_font_path_precomputed(fc, font_queries_monospace);
 
     assert(ui_font_path != nullptr);
     assert(monospace_font_path != nullptr);
 
     ImGuiIO &io = ImGui::GetIO(); (void)io;
-    ui_font = io.Fonts->AddFontFromFileTTF(ui_font_path, font_size);
-    monospace_font = io.Fonts->AddFontFromFileTTF(monospace_font_path, font_size);
+    ui_font = imgui_add_font_from_file(ui_font_path, font_size);
+    monospace_font = imgui_add_font_from_file(monospace_font_path, font_size);
+    io.FontDefault = ui_font;
+
+    imgui_set_glyph_fallback_cache(fc);
+
+    // rasterizes the fonts, unless they're in the atlas cache already
+    imgui_build_font_atlas();
+
+    // the font texture was already built with the default font
+    ImGui_ImplOpenGL3_DestroyFontsTexture();
+    ImGui_ImplOpenGL3_CreateFontsTexture();
 }
 
 static void _set_imgui_style_and_colors()
@@ -133,6 +155,17 @@ int main(int argc, const char *argv[])
     (void)argc;
     (void)argv;
 
+    // the font cache is built while the window is being created,
+    // until it's done ImGui's default font is used.
+    font_cache_load = ff_load_font_cache_async();
+    defer
+    {
+        if (font_cache_load != nullptr)
+            ff_unload_font_cache(ff_cache_load_wait(font_cache_load));
+
+        ff_unload_font_cache(font_cache);
+    };
+
     window_init();
     defer { window_exit(); };
 
@@ -142,10 +175,9 @@ int main(int argc, const char *argv[])
     imgui_init(window);
     defer { imgui_exit(window); };
 
-    _load_imgui_fonts();
     _set_imgui_style_and_colors();
 
-    window_event_loop(window, _update, default_render_function, 10.f);
+    window_event_loop(window, _update, skip_unchanged_render_function, 10.f, window_LoopFlags_Idle);
 
     return 0;
 }
@@ -43,6 +43,7 @@ static void free(colorscheme_settings *settings)
 };
 
 static colorscheme_settings _ini_settings;
+static int _init_count = 0; // ImGui contexts colorscheme_init was called in
 
 static void _colorscheme_ClearAllFn(ImGuiContext* ctx, ImGuiSettingsHandler* handler)
 {
@@ -103,7 +104,9 @@ static void _colorscheme_WriteAllFn(ImGuiContext* ctx, ImGuiSettingsHandler* han
 
 void ui::colorscheme_init()
 {
-    init(&_ini_settings);
+    // the settings are shared by all ImGui contexts, the handler is per context
+    if (_init_count++ == 0)
+        init(&_ini_settings);
 
     ImGuiSettingsHandler ini_handler{};
     ini_handler.TypeName = "Colorscheme";
@@ -117,7 +120,8 @@ void ui::colorscheme_init()
 
 void ui::colorscheme_free()
 {
-    free(&_ini_settings);
+    if (--_init_count == 0)
+        free(&_ini_settings);
 }
 
 void ui::colorscheme_get_all(const ui::colorscheme **out, int *out_count)
@@ -13,6 +13,7 @@ struct colorscheme
     colorscheme_apply_function apply;
 };
 
+// once per ImGui context, imgui_init and imgui_exit do
 void colorscheme_init();
 void colorscheme_free();
 void colorscheme_get_all(const ui::colorscheme **out, int *out_count);
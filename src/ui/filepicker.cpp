@@ -17,6 +17,7 @@
 
 #include "ui/filepicker.hpp"
 #include "ui/utils.hpp"
+#include "window/imgui_fonts.hpp"
 
 #define ui_Ini_Name "ui"
 #define ui_Ini_Preferences "Preferences"
@@ -291,6 +292,7 @@ struct ui_fs_ini_settings
 };
 
 static ui_fs_ini_settings _ini_settings;
+static int _init_count = 0; // ImGui contexts filepicker_init was called in
 
 static void init(ui_fs_ini_settings *settings)
 {
@@ -418,7 +420,10 @@ static void _ui_fs_WriteAllFn(ImGuiContext* ctx, ImGuiSettingsHandler* handler,
 
 void ui::filepicker_init()
 {
-    init(&_ini_settings);
+    // the settings are shared by all ImGui contexts, the handler is per context
+    if (_init_count++ == 0)
+        init(&_ini_settings);
+
     ImGuiSettingsHandler ini_handler{};
     ini_handler.TypeName = ui_Ini_Name;
     ini_handler.TypeHash = ImHashStr(ui_Ini_Name);
@@ -431,7 +436,8 @@ void ui::filepicker_init()
 
 void ui::filepicker_exit()
 {
-    free(&_ini_settings);
+    if (--_init_count == 0)
+        free(&_ini_settings);
 }
 
 #define ui_fs_dialog_label_size 32
@@ -1161,6 +1167,8 @@ bool FileDialog(const char *label, char *out_filebuf, size_t filebuf_size, const
 
             for_array(i, seg, &diag->current_dir_segments)
             {
+                imgui_request_glyphs(seg->c_str, seg->c_str + seg->size);
+
                 // (we skip the last entry, the button for the last entry does nothing)
                 if (ButtonSlice(seg->c_str, seg->c_str + seg->size, ImVec2(0, 0), 0) && i < diag->current_dir_segments.size - 1)
                 {
@@ -1246,6 +1254,8 @@ bool FileDialog(const char *label, char *out_filebuf, size_t filebuf_size, const
         for_array(i, pin, &_ini_settings.pins)
         {
             ImGui::PushID((int)i);
+            imgui_request_glyphs(pin->name.c_str, pin->name.c_str + pin->name.size);
+
             if (ImGui::Selectable(pin->name.c_str))
             {
                 diag->selection_buffer[0] = '\0';
@@ -1378,6 +1388,9 @@ bool FileDialog(const char *label, char *out_filebuf, size_t filebuf_size, const
 
                 bool navigate_into = false;
 
+                // file names may have any characters
+                imgui_request_glyphs(item->path.data);
+
                 // TODO: if (single/multi select ...)
                 if (ImGui::Selectable(item->path.data, diag->single_selection_index == i, ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowDoubleClick))
                 {
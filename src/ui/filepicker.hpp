@@ -20,6 +20,7 @@ namespace ui
 // "Any files|*.*|Office files|*.doc;*.docx;*.xlsx|Specific file|EBOOT.BIN"
 #define ui_DefaultDialogFilter "Any files|*.*"
 
+// once per ImGui context, imgui_init and imgui_exit do
 void filepicker_init();
 void filepicker_exit();
 
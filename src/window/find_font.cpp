@@ -17,6 +17,7 @@ See below for implementation-specific documentation.
 #include "shl/platform.hpp"
 #include "shl/allocator.hpp"
 #include "shl/hash_table.hpp"
+#include "shl/time.hpp"
 
 #include "find_font.hpp"
 
@@ -58,6 +59,7 @@ struct ff_cache
 {
     hash_table<string, string> entries;
     string name_buffer;
+    ff_cache_stats stats;
     ::allocator allocator;
 };
 
@@ -180,27 +182,285 @@ static bool _load_registry_fonts(ff_cache *c)
     return ret;
 }
 
+// every registry value is one font, named by its full name.
+static void _registry_stats(ff_cache *c, const timespan *start)
+{
+    timespan now;
+    get_time(&now);
+
+    fill_memory(&c->stats, 0);
+    c->stats.patterns = (int)c->entries.size;
+    c->stats.families = (int)c->entries.size;
+    c->stats.styles = (int)c->entries.size;
+    c->stats.total_seconds = get_seconds_difference(start, &now);
+}
+
 #elif Linux
 #include <dirent.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
-#include "shl/streams.hpp"
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#include <stdlib.h>
+#include <stdio.h> // rename
+#include "shl/sort.hpp"
 
 #define FF_DEFAULT_STYLE "Regular"
 
-struct ff_cache_entry_style
+static double _ff_seconds_since(const timespan *start)
 {
-    string style_name;
-    string path;
+    timespan now;
+    get_time(&now);
+    return get_seconds_difference(start, &now);
+}
+
+// same as ff_hash, so precomputed queries can be looked up directly
+static inline u64 _ff_hash(const char *str, s64 size)
+{
+    return ff_hash(str, (u64)size);
+}
+
+static inline u64 _ff_hash(const_string str)
+{
+    return _ff_hash(str.c_str, str.size);
+}
+
+/* String arena
+
+All strings of the builder (family names, style names and paths) live in a
+single block of memory which is allocated once all cache files are parsed,
+at which point the total size of all strings is known.
+Strings are interned, so every distinct string is stored exactly once, e.g.
+"Regular" or "Bold" only once for all families, and paths of font collections
+(.ttc) only once for all faces inside of them.
+Directory prefixes of paths are not shared because lookups return the path
+as a single nul-terminated string.
+
+The arena is copied as-is into the image, so offsets within the arena are
+also offsets within the strings of the image.
+*/
+struct ff_string_arena_slot
+{
+    u64 hash;
+    u32 offset; // offset + 1, 0 = empty slot
+    u32 size;
+};
+
+struct ff_string_arena
+{
+    char *data;
+    s64 size;
+    s64 used;
+    ff_string_arena_slot *slots;
+    u32 slot_count;
+    ::allocator allocator;
+};
+
+static bool init(ff_string_arena *arena, s64 size, s64 max_string_count, ::allocator a)
+{
+    u32 slot_count = 16;
+
+    while ((s64)slot_count < max_string_count * 2)
+        slot_count <<= 1;
+
+    arena->allocator = a;
+    arena->size = size > 0 ? size : 1;
+    arena->used = 0;
+    arena->slot_count = slot_count;
+    arena->data = (char*)allocator_alloc(a, arena->size);
+    arena->slots = (ff_string_arena_slot*)allocator_alloc(a, sizeof(ff_string_arena_slot) * slot_count);
+
+    if (arena->data == nullptr || arena->slots == nullptr)
+        return false;
+
+    fill_memory(arena->slots, 0, sizeof(ff_string_arena_slot) * slot_count);
+    return true;
+}
+
+static void free(ff_string_arena *arena)
+{
+    if (arena->data != nullptr)
+        allocator_dealloc(arena->allocator, arena->data, arena->size);
+
+    if (arena->slots != nullptr)
+        allocator_dealloc(arena->allocator, arena->slots, sizeof(ff_string_arena_slot) * arena->slot_count);
+
+    arena->data = nullptr;
+    arena->slots = nullptr;
+}
+
+// returns the interned copy of str, nul-terminated.
+static const_string _ff_intern(ff_string_arena *arena, const_string str)
+{
+    u64 h = _ff_hash(str);
+    u32 mask = arena->slot_count - 1;
+    u32 slot = (u32)h & mask;
+
+    for (; arena->slots[slot].offset != 0; slot = (slot + 1) & mask)
+    {
+        ff_string_arena_slot *sl = arena->slots + slot;
+
+        if (sl->hash != h || (s64)sl->size != str.size)
+            continue;
+
+        const_string interned = to_const_string(arena->data + sl->offset - 1, sl->size);
+
+        if (interned == str)
+            return interned;
+    }
+
+    // the arena is sized for all strings that may be interned
+    assert(arena->used + str.size + 1 <= arena->size);
+
+    char *ret = arena->data + arena->used;
+    copy_memory(str.c_str, ret, str.size);
+    ret[str.size] = '\0';
+
+    arena->slots[slot].hash = h;
+    arena->slots[slot].offset = (u32)arena->used + 1;
+    arena->slots[slot].size = (u32)str.size;
+    arena->used += str.size + 1;
+
+    return to_const_string(ret, str.size);
+}
+
+static inline u32 _ff_arena_offset(const ff_string_arena *arena, const_string str)
+{
+    return (u32)(str.c_str - arena->data);
+}
+
+/* Coverage
+
+Which codepoints a font has glyphs for is stored as a sparse page bitmap,
+same as fontconfig charsets: a page covers 256 codepoints (codepoint >> 8),
+and each page that has at least one codepoint has a leaf of 256 bits.
+Leaves are deduplicated (many fonts share e.g. the complete Basic Latin
+page), so a font is a sorted list of (page, leaf index) pairs.
+
+Only pages below FF_COVERAGE_PAGE_COUNT exist, i.e. up to U+10FFFF.
+*/
+#define FF_COVERAGE_PAGE_COUNT 0x1100
+
+struct ff_coverage_leaf
+{
+    u32 map[8];
+};
+
+// a page with its leaf as parsed, before leaves are deduplicated
+struct ff_coverage_page
+{
+    u32 page;
+    ff_coverage_leaf leaf;
+};
+
+// a page of a font in the builder or the image
+struct ff_coverage_ref
+{
+    u32 page;
+    u32 leaf;
+};
+
+static inline bool _ff_leaf_has(const ff_coverage_leaf *leaf, u32 codepoint)
+{
+    return (leaf->map[(codepoint >> 5) & 7] >> (codepoint & 31)) & 1;
+}
+
+// like the string arena, sized once for the worst case of no duplicate leaves.
+struct ff_leaf_table
+{
+    ff_coverage_leaf *leaves;
+    s64 size;
+    s64 used;
+    u32 *slots; // leaf index + 1, 0 = empty slot
+    u32 slot_count;
+    ::allocator allocator;
 };
 
-static void free(ff_cache_entry_style *entry_style)
+static bool init(ff_leaf_table *table, s64 max_leaf_count, ::allocator a)
+{
+    u32 slot_count = 16;
+
+    while ((s64)slot_count < max_leaf_count * 2)
+        slot_count <<= 1;
+
+    table->allocator = a;
+    table->size = max_leaf_count > 0 ? max_leaf_count : 1;
+    table->used = 0;
+    table->slot_count = slot_count;
+    table->leaves = (ff_coverage_leaf*)allocator_alloc(a, sizeof(ff_coverage_leaf) * table->size);
+    table->slots = (u32*)allocator_alloc(a, sizeof(u32) * slot_count);
+
+    if (table->leaves == nullptr || table->slots == nullptr)
+        return false;
+
+    fill_memory(table->slots, 0, sizeof(u32) * slot_count);
+    return true;
+}
+
+static void free(ff_leaf_table *table)
+{
+    if (table->leaves != nullptr)
+        allocator_dealloc(table->allocator, table->leaves, sizeof(ff_coverage_leaf) * table->size);
+
+    if (table->slots != nullptr)
+        allocator_dealloc(table->allocator, table->slots, sizeof(u32) * table->slot_count);
+
+    table->leaves = nullptr;
+    table->slots = nullptr;
+}
+
+// returns the index of the interned copy of leaf.
+static u32 _ff_intern_leaf(ff_leaf_table *table, const ff_coverage_leaf *leaf)
 {
-    free(&entry_style->style_name);
-    free(&entry_style->path);
+    u64 h = _ff_hash((const char*)leaf->map, sizeof(leaf->map));
+    u32 mask = table->slot_count - 1;
+    u32 slot = (u32)h & mask;
+
+    for (; table->slots[slot] != 0; slot = (slot + 1) & mask)
+    {
+        const ff_coverage_leaf *other = table->leaves + (table->slots[slot] - 1);
+        bool equal = true;
+
+        for (int i = 0; i < 8 && equal; ++i)
+            equal = other->map[i] == leaf->map[i];
+
+        if (equal)
+            return table->slots[slot] - 1;
+    }
+
+    assert(table->used < table->size);
+
+    u32 ret = (u32)table->used;
+    table->leaves[ret] = *leaf;
+    table->slots[slot] = ret + 1;
+    table->used += 1;
+
+    return ret;
 }
 
+// a single font as read from a source file.
+// first_page and page_count are the coverage of the font within the pages
+// of whoever owns the record (ff_parsed_file::pages or ff_cache_builder::pages).
+struct ff_font_record
+{
+    const_string name;
+    const_string style;
+    const_string path;
+    u32 first_page;
+    u32 page_count;
+};
+
+// style_id is the index of the style name in ff_cache_builder::style_names,
+// path points into the builders string arena, record is the index of the
+// record the style came from (for its coverage).
+struct ff_cache_entry_style
+{
+    u32 style_id;
+    u32 record;
+    const_string path;
+};
+
 struct ff_cache_entry
 {
     array<ff_cache_entry_style> styles;
@@ -208,29 +468,54 @@ struct ff_cache_entry
 
 static void free(ff_cache_entry *entry)
 {
-    free<true>(&entry->styles);
+    free(&entry->styles);
 }
 
-struct ff_cache
+// fonts are collected in a builder while parsing, which is then flattened
+// into the image that's used for lookups, see IMAGE DOCUMENTATION below.
+// style names are interned to small integer ids (index into style_names) while
+// loading, so finding a style of a family is an integer compare.
+// records are all fonts of all source files in file order (including ones
+// shadowed by an earlier file), strings interned, so a refresh can reuse them.
+struct ff_cache_builder
 {
-    hash_table<string, ff_cache_entry> entries;
+    hash_table<const_string, ff_cache_entry> entries;
+    hash_table<const_string, u32> style_ids;
+    array<const_string> style_names;
+    array<ff_font_record> records;
+    array<ff_coverage_ref> pages;
+    ff_string_arena strings;
+    ff_leaf_table leaves;
     ::allocator allocator;
 };
 
-static void init(ff_cache *cache)
+static void init(ff_cache_builder *b)
 {
-    init(&cache->entries);
+    init(&b->entries);
+    init(&b->style_ids);
+    init(&b->style_names);
+    init(&b->records);
+    init(&b->pages);
+    b->strings = {};
+    b->leaves = {};
 }
 
-static void free(ff_cache *cache)
+static void free(ff_cache_builder *b)
 {
-    free<true, true>(&cache->entries);
+    // keys and names are in the string arena
+    free<false, true>(&b->entries);
+    free(&b->style_ids);
+    free(&b->style_names);
+    free(&b->records);
+    free(&b->pages);
+    free(&b->strings);
+    free(&b->leaves);
 }
 
-static ff_cache_entry_style *_ff_find_style(ff_cache_entry *e, const_string style)
+static ff_cache_entry_style *_ff_find_style(ff_cache_entry *e, u32 style_id)
 {
     for_array(st, &e->styles)
-        if (to_const_string(st->style_name) == style)
+        if (st->style_id == style_id)
             return st;
 
     return nullptr;
@@ -249,7 +534,8 @@ of fonts.
 directories, but I'm not going to parse config files to find out where
 cache files are.
 These two paths are the simplest cache directories I could find.
-Probably won't work on something like NixOS though.
+Probably won't work on something like NixOS though, in which case the
+font directories are read directly, see FONT FILE DOCUMENTATION.
 
 Cache files have strange names which look like
 
@@ -429,14 +715,91 @@ The object_ids that we use in this implementation.
 #define FC_FAMILY_OBJECT    1
 #define FC_STYLE_OBJECT     3
 #define FC_FILE_OBJECT      21
+#define FC_CHARSET_OBJECT   33
+
+/*
+https://gitlab.freedesktop.org/fontconfig/fontconfig/-/blob/e3563fa20d3b04f6033eddf062c2d624036777f5/src/fcint.h#L336
+
+The set of codepoints a font has glyphs for (FC_CHARSET_OBJECT), the value
+of a fontconfig_value of type FcTypeCharSet points to it (relative to the value).
+num is the number of leaves and numbers.
+numbers_offset points to num u16 page numbers (codepoint >> 8), sorted.
+leaves_offset points to num offsets, each of which points to the leaf of
+the page with the same index. Offsets of leaves are relative to the start
+of the offsets, not the charset.
+A leaf is a bitmap of the 256 codepoints of a page.
+*/
+struct fontconfig_charset
+{
+    int ref;
+    int num;
+    sys_int leaves_offset;
+    sys_int numbers_offset;
+};
+
+struct fontconfig_charleaf
+{
+    u32 map[8];
+};
+
+/* A cache file that was found in one of the cache directories.
+Size and modification time are kept so a snapshot (see below) can tell whether
+it is still up to date.
+first_record and record_count are the fonts of the file within
+ff_cache_builder::records, set when merging, see ff_cache_refresh.
+*/
+struct ff_cache_source
+{
+    string path;
+    s64 size;
+    s64 mtime_sec;
+    s64 mtime_nsec;
+    u32 first_record;
+    u32 record_count;
+};
+
+static void free(ff_cache_source *src)
+{
+    free(&src->path);
+}
+
+// compares bytes as unsigned, shorter strings come first.
+static int _ff_compare_strings(const_string a, const_string b)
+{
+    s64 n = a.size < b.size ? a.size : b.size;
+
+    for (s64 i = 0; i < n; ++i)
+    {
+        u8 ca = (u8)a.c_str[i];
+        u8 cb = (u8)b.c_str[i];
 
-static void _find_cache_files(const_string dir, array<string> *cache_files, ::allocator allocator)
+        if (ca < cb) return -1;
+        if (ca > cb) return  1;
+    }
+
+    if (a.size < b.size) return -1;
+    if (a.size > b.size) return  1;
+
+    return 0;
+}
+
+static int _compare_cache_sources(const ff_cache_source *lhs, const ff_cache_source *rhs)
+{
+    return _ff_compare_strings(to_const_string(lhs->path), to_const_string(rhs->path));
+}
+
+// files of a single directory are sorted by name so the order doesn't depend on
+// the order readdir returns them in, the order of the directories themselves is kept.
+static void _find_cache_files(const_string dir, array<ff_cache_source> *cache_files, ::allocator allocator)
 {
     DIR *d = opendir(dir.c_str);
 
     if (d == nullptr)
         return;
 
+    s64 first = cache_files->size;
+    struct statx st{};
+
     for (dirent *ent = readdir(d); ent != nullptr; ent = readdir(d))
     {
         const_string filename = to_const_string((const char*)ent->d_name);
@@ -447,19 +810,199 @@ static void _find_cache_files(const_string dir, array<string> *cache_files, ::al
         if (!contains(filename, ".cache"))
             continue;
 
-        string *added_filename = add_at_end(cache_files);
-        added_filename->allocator = allocator;
-        init(added_filename, dir);
-        string_append(added_filename, "/");
-        string_append(added_filename, filename);
+        ff_cache_source *src = add_at_end(cache_files);
+        fill_memory(src, 0);
+        src->path.allocator = allocator;
+        init(&src->path, dir);
+        string_append(&src->path, "/");
+        string_append(&src->path, filename);
+
+        if (statx(AT_FDCWD, src->path.data, 0, STATX_SIZE | STATX_MTIME, &st) == 0)
+        {
+            src->size = (s64)st.stx_size;
+            src->mtime_sec = (s64)st.stx_mtime.tv_sec;
+            src->mtime_nsec = (s64)st.stx_mtime.tv_nsec;
+        }
     }
 
     closedir(d);
+
+    if (cache_files->size - first > 1)
+        sort(cache_files->data + first, cache_files->size - first, _compare_cache_sources);
+}
+
+/* Cache files are mapped read-only instead of being read into a buffer.
+The cache files are made to be mapped (fontconfig itself does so), all the
+strings we care about are referenced in place and only copied once they're
+added to the ff_cache, after which the file is unmapped again.
+Because the mapping is read-only, nothing inside the mapped file may be
+modified, so offsets are fixed up in local variables.
+*/
+struct ff_mapped_file
+{
+    const char *data;
+    s64 size;
+};
+
+static bool _map_file(const char *path, ff_mapped_file *out)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return false;
+
+    defer { close(fd); };
+
+    struct stat st{};
+
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+        return false;
+
+    void *data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (data == MAP_FAILED)
+        return false;
+
+    out->data = (const char*)data;
+    out->size = (s64)st.st_size;
+    return true;
+}
+
+static void _unmap_file(ff_mapped_file *file)
+{
+    if (file->data != nullptr)
+        munmap((void*)file->data, (size_t)file->size);
+
+    file->data = nullptr;
+    file->size = 0;
+}
+
+/* Worker threads
+
+Cache files are parsed on a small pool of threads. Each file is parsed into
+its own list of font records, which only point into the (still mapped) file.
+Once all files are parsed, the calling thread adds the records to the ff_cache
+in the order the files were found, so "first found wins" for duplicate
+family / style pairs is exactly the same as parsing the files one after another.
+This also means only the calling thread ever touches the ff_cache itself.
+*/
+#include <pthread.h>
+
+#define FF_MAX_WORKER_THREADS 8
+
+typedef void (*ff_parallel_function)(s64 index, void *userdata);
+
+struct ff_parallel_job
+{
+    ff_parallel_function function;
+    void *userdata;
+    s64 count;
+    s64 next_index;
+};
+
+static void *_ff_parallel_worker(void *_job)
+{
+    ff_parallel_job *job = (ff_parallel_job*)_job;
+
+    while (true)
+    {
+        s64 i = __atomic_fetch_add(&job->next_index, 1, __ATOMIC_RELAXED);
+
+        if (i >= job->count)
+            break;
+
+        job->function(i, job->userdata);
+    }
+
+    return nullptr;
+}
+
+// calls function(i, userdata) for every i in [0, count), in no particular order.
+// the calling thread is one of the workers.
+static void _ff_parallel_for(s64 count, ff_parallel_function function, void *userdata)
+{
+    if (count <= 0)
+        return;
+
+    ff_parallel_job job{};
+    job.function = function;
+    job.userdata = userdata;
+    job.count = count;
+    job.next_index = 0;
+
+    s64 thread_count = (s64)sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (thread_count > FF_MAX_WORKER_THREADS)
+        thread_count = FF_MAX_WORKER_THREADS;
+
+    if (thread_count > count)
+        thread_count = count;
+
+    pthread_t threads[FF_MAX_WORKER_THREADS];
+    s64 started = 0;
+
+    // one less because the calling thread works too
+    for (; started < thread_count - 1; ++started)
+        if (pthread_create(threads + started, nullptr, _ff_parallel_worker, &job) != 0)
+            break;
+
+    _ff_parallel_worker(&job);
+
+    for (s64 i = 0; i < started; ++i)
+        pthread_join(threads[i], nullptr);
+}
+
+enum ff_parse_result
+{
+    ff_Parse_Ok,
+    ff_Parse_CouldNotRead,
+    ff_Parse_Invalid,
+    ff_Parse_InvalidMagic,
+    ff_Parse_SkippedVersion
+};
+
+// a parsed fontconfig cache file or font file.
+// records of cache files point into the mapped file, records of font files
+// point into names (font files are unmapped right after parsing).
+struct ff_parsed_file
+{
+    ff_mapped_file file;
+    array<ff_font_record> fonts;
+    array<ff_coverage_page> pages;
+    string names;
+    ff_parse_result result;
+    u32 magic;
+    bool parsed; // false if reused, see _ff_reuse_records
+};
+
+static void free(ff_parsed_file *pfile)
+{
+    _unmap_file(&pfile->file);
+    free(&pfile->fonts);
+    free(&pfile->pages);
+    free(&pfile->names);
+}
+
+typedef ff_parse_result (*ff_parse_function)(const_string filepath, ff_parsed_file *out);
+
+// whether the size bytes at offset from p are within the file.
+// offsets come from the file, so they're checked before they're added to p.
+static bool _fontconfig_in_file(const ff_mapped_file *file, const void *p, s64 offset, s64 size)
+{
+    s64 start = (s64)((const char*)p - file->data);
+
+    if (start < 0 || start > file->size || offset < -start || offset > file->size - start)
+        return false;
+
+    start += offset;
+
+    return size >= 0 && size <= file->size - start;
 }
 
+// the elts of p must be within the file, see _fontconfig_pattern_in_file.
 static int _fontconfig_find_pattern_object_index(const fontconfig_pattern *p, int object_id)
 {
-    fontconfig_elt *elts = (fontconfig_elt*)((char*)p + (p->elts_offset & ~1));
+    const fontconfig_elt *elts = (const fontconfig_elt*)((const char*)p + (p->elts_offset & ~1));
 
     int low = 0;
     int high = p->elts_count - 1;
@@ -487,184 +1030,2459 @@ static int _fontconfig_find_pattern_object_index(const fontconfig_pattern *p, in
     return -(mid + 1);
 }
 
-static const char *_fontconfig_find_pattern_string_object(const fontconfig_pattern *p, int object_id)
+// whether the pattern and its elts are within the file.
+static bool _fontconfig_pattern_in_file(const ff_mapped_file *file, const fontconfig_pattern *p)
+{
+    if (!_fontconfig_in_file(file, p, 0, (s64)sizeof(fontconfig_pattern)) || p->elts_count < 0)
+        return false;
+
+    return _fontconfig_in_file(file, p, (s64)(p->elts_offset & ~1), (s64)p->elts_count * (s64)sizeof(fontconfig_elt));
+}
+
+// sets out to the first value of the given type of the object, or nullptr.
+// returns false if the value list is not within the file.
+static bool _fontconfig_find_pattern_value(const ff_mapped_file *file, const fontconfig_pattern *p, int object_id, fc_value_type type, const fontconfig_value **out)
 {
-    fontconfig_elt *elts = (fontconfig_elt*)((char*)p + (p->elts_offset & ~1));
+    *out = nullptr;
+
+    const fontconfig_elt *elts = (const fontconfig_elt*)((const char*)p + (p->elts_offset & ~1));
     
     int index = _fontconfig_find_pattern_object_index(p, object_id);
 
     if (index < 0)
-        return nullptr;
+        return true;
 
-    fontconfig_elt *elt = elts + index;
+    const fontconfig_elt *elt = elts + index;
 
     if (elt->value_list_offset == 0)
-        return nullptr;
+        return true;
 
-    fontconfig_value_list *list = (fontconfig_value_list*)((char*)elt + (elt->value_list_offset & ~1));
-    fontconfig_value *val = nullptr;
+    const char *prev = (const char*)elt;
+    s64 offset = (s64)(elt->value_list_offset & ~1);
 
-    while (true)
+    // a list longer than this loops
+    s64 max_count = file->size / (s64)sizeof(fontconfig_value_list);
+
+    for (s64 i = 0; i < max_count; ++i)
     {
-        val = &list->value;
+        if (!_fontconfig_in_file(file, prev, offset, (s64)sizeof(fontconfig_value_list)))
+            return false;
 
-        if (val->type == FcTypeString)
-            return (char*)val + (val->value & ~1);
+        const fontconfig_value_list *list = (const fontconfig_value_list*)(prev + offset);
+
+        if (list->value.type == type)
+        {
+            *out = &list->value;
+            return true;
+        }
 
         if (list->next_offset == 0)
-            break;
+            return true;
 
-        list = (fontconfig_value_list*)((char*)list + (list->next_offset & ~1));
+        prev = (const char*)list;
+        offset = (s64)(list->next_offset & ~1);
     }
 
-    return nullptr;
+    return false;
 }
 
-static void _parse_fontconfig_cache_file(ff_cache *c, const_string filepath, string *buffer)
+// sets out to the string of the object, or nullptr.
+// returns false if the string is not within the file or not terminated.
+static bool _fontconfig_find_pattern_string_object(const ff_mapped_file *file, const fontconfig_pattern *p, int object_id, const char **out)
 {
-    if (!read_entire_file(filepath.c_str, buffer))
-    {
-        tprint("  could not read %\n", filepath);
-        return;
-    }
+    *out = nullptr;
 
-    memory_stream contents{};
-    contents.data = buffer->data;
-    contents.size = buffer->size - 1;
-    contents.position = 0;
-    contents.allocator = c->allocator;
+    const fontconfig_value *val = nullptr;
 
-    if (contents.size < (s64)sizeof(fontconfig_cache))
-    {
-        tprint("  invalid fontconfig cache: %\n", filepath);
-        return;
-    }
+    if (!_fontconfig_find_pattern_value(file, p, object_id, FcTypeString, &val))
+        return false;
 
-    fontconfig_cache fc_cache{};
-    read(&contents, &fc_cache);
+    if (val == nullptr)
+        return true;
 
-    if (fc_cache.magic != FC_CACHE_MAGIC_MMAP && fc_cache.magic != FC_CACHE_MAGIC_ALLOC)
-    {
-        tprint("  invalid magic number % in file: %\n", fc_cache.magic, filepath);
-        return;
-    }
+    s64 offset = (s64)(val->value & ~1);
 
-    if (fc_cache.version != FC_CACHE_VERSION_NUMBER)
-    {
-        // tprint("  skipping version % in file: %\n", fc_cache.version, filepath);
-        return;
-    }
+    if (!_fontconfig_in_file(file, val, offset, 0))
+        return false;
 
-    fontconfig_fontset *fs = (fontconfig_fontset*)(contents.data + fc_cache.fontset_offset);
+    const char *str = (const char*)val + offset;
+    const char *end = file->data + file->size;
 
-    if (fs == nullptr || fs->pattern_count <= 0)
-        return;
+    for (const char *c = str; c < end; ++c)
+        if (*c == '\0')
+        {
+            *out = str;
+            return true;
+        }
 
-    fs->patterns_offset &= ~1;
-    s64 *font_offsets = (s64*)((char*)fs + fs->patterns_offset);
+    return false;
+}
 
-    for (int i = 0; i < fs->pattern_count; ++i)
-    {
+// sets out to the charset of the pattern, or nullptr.
+// returns false if the charset is not within the file.
+static bool _fontconfig_find_pattern_charset(const ff_mapped_file *file, const fontconfig_pattern *p, const fontconfig_charset **out)
+{
+    *out = nullptr;
+
+    const fontconfig_value *val = nullptr;
+
+    if (!_fontconfig_find_pattern_value(file, p, FC_CHARSET_OBJECT, FcTypeCharSet, &val))
+        return false;
+
+    if (val == nullptr)
+        return true;
+
+    s64 offset = (s64)(val->value & ~1);
+
+    if (!_fontconfig_in_file(file, val, offset, (s64)sizeof(fontconfig_charset)))
+        return false;
+
+    *out = (const fontconfig_charset*)((const char*)val + offset);
+    return true;
+}
+
+// appends the pages of the charset to pages, returns false if the charset
+// is not within the file.
+static bool _fontconfig_read_charset(const ff_mapped_file *file, const fontconfig_charset *cs, array<ff_coverage_page> *pages)
+{
+    if (!_fontconfig_in_file(file, cs, 0, (s64)sizeof(fontconfig_charset)) || cs->num < 0)
+        return false;
+
+    s64 leaves_offset = (s64)(cs->leaves_offset & ~1);
+    s64 numbers_offset = (s64)(cs->numbers_offset & ~1);
+
+    if (!_fontconfig_in_file(file, cs, leaves_offset, (s64)cs->num * (s64)sizeof(sys_int))
+     || !_fontconfig_in_file(file, cs, numbers_offset, (s64)cs->num * (s64)sizeof(u16)))
+        return false;
+
+    const sys_int *leaf_offsets = (const sys_int*)((const char*)cs + leaves_offset);
+    const u16 *numbers = (const u16*)((const char*)cs + numbers_offset);
+
+    for (int i = 0; i < cs->num; ++i)
+    {
+        if (numbers[i] >= FF_COVERAGE_PAGE_COUNT)
+            break;
+
+        s64 leaf_offset = (s64)(leaf_offsets[i] & ~1);
+
+        if (!_fontconfig_in_file(file, leaf_offsets, leaf_offset, (s64)sizeof(fontconfig_charleaf)))
+            return false;
+
+        const fontconfig_charleaf *leaf = (const fontconfig_charleaf*)((const char*)leaf_offsets + leaf_offset);
+
+        ff_coverage_page *page = add_at_end(pages);
+        page->page = numbers[i];
+        copy_memory(leaf->map, page->leaf.map, sizeof(page->leaf.map));
+    }
+
+    return true;
+}
+
+static ff_parse_result _parse_fontconfig_cache_file(const_string filepath, ff_parsed_file *out)
+{
+    if (!_map_file(filepath.c_str, &out->file))
+        return ff_Parse_CouldNotRead;
+
+    const ff_mapped_file *file = &out->file;
+
+    if (file->size < (s64)sizeof(fontconfig_cache))
+        return ff_Parse_Invalid;
+
+    const fontconfig_cache *fc_cache = (const fontconfig_cache*)file->data;
+    out->magic = fc_cache->magic;
+
+    if (fc_cache->magic != FC_CACHE_MAGIC_MMAP && fc_cache->magic != FC_CACHE_MAGIC_ALLOC)
+        return ff_Parse_InvalidMagic;
+
+    if (fc_cache->version != FC_CACHE_VERSION_NUMBER)
+        return ff_Parse_SkippedVersion;
+
+    s64 fontset_offset = (s64)fc_cache->fontset_offset;
+
+    if (fontset_offset <= 0 || fontset_offset + (s64)sizeof(fontconfig_fontset) > file->size)
+        return ff_Parse_Invalid;
+
+    const fontconfig_fontset *fs = (const fontconfig_fontset*)(file->data + fontset_offset);
+
+    if (fs->pattern_count <= 0)
+        return ff_Parse_Ok;
+
+    s64 patterns_offset = (s64)(fs->patterns_offset & ~1);
+
+    if (!_fontconfig_in_file(file, fs, patterns_offset, (s64)fs->pattern_count * (s64)sizeof(s64)))
+        return ff_Parse_Invalid;
+
+    const s64 *font_offsets = (const s64*)((const char*)fs + patterns_offset);
+
+    for (int i = 0; i < fs->pattern_count; ++i)
+    {
         s64 font_offset = font_offsets[i];
         font_offset &= ~1;
 
-        auto *font = (fontconfig_pattern*)((char*)fs + (font_offset & ~1));
+        if (!_fontconfig_in_file(file, fs, font_offset, (s64)sizeof(fontconfig_pattern)))
+            return ff_Parse_Invalid;
+
+        auto *font = (const fontconfig_pattern*)((const char*)fs + font_offset);
+
+        if (!_fontconfig_pattern_in_file(file, font))
+            return ff_Parse_Invalid;
+
+        const char *name  = nullptr;
+        const char *style = nullptr;
+        const char *path  = nullptr;
+
+        if (!_fontconfig_find_pattern_string_object(file, font, FC_FAMILY_OBJECT, &name)
+         || !_fontconfig_find_pattern_string_object(file, font, FC_STYLE_OBJECT, &style)
+         || !_fontconfig_find_pattern_string_object(file, font, FC_FILE_OBJECT, &path))
+            return ff_Parse_Invalid;
+
+        if (name == nullptr || path == nullptr)
+            continue;
+
+        if (style == nullptr)
+            style = "";
+
+        ff_font_record *rec = add_at_end(&out->fonts);
+        rec->name  = to_const_string(name);
+        rec->style = to_const_string(style);
+        rec->path  = to_const_string(path);
+        rec->first_page = (u32)out->pages.size;
+
+        const fontconfig_charset *cs = nullptr;
+
+        if (!_fontconfig_find_pattern_charset(file, font, &cs))
+            return ff_Parse_Invalid;
+
+        if (cs != nullptr && !_fontconfig_read_charset(file, cs, &out->pages))
+            return ff_Parse_Invalid;
+
+        rec->page_count = (u32)(out->pages.size - rec->first_page);
+    }
+
+    return ff_Parse_Ok;
+}
+
+// pages are the pages of the parsed file rec is from.
+static void _ff_add_font(ff_cache_builder *b, const ff_font_record *rec, const ff_coverage_page *pages)
+{
+    u32 record_index = (u32)b->records.size;
+    ff_font_record *brec = add_at_end(&b->records);
+    brec->name = _ff_intern(&b->strings, rec->name);
+    brec->path = _ff_intern(&b->strings, rec->path);
+    brec->first_page = (u32)b->pages.size;
+    brec->page_count = rec->page_count;
+
+    for (u32 i = 0; i < rec->page_count; ++i)
+    {
+        const ff_coverage_page *page = pages + rec->first_page + i;
+        ff_coverage_ref *ref = add_at_end(&b->pages);
+        ref->page = page->page;
+        ref->leaf = _ff_intern_leaf(&b->leaves, &page->leaf);
+    }
+
+    // like style ids, families whose names have the same hash stay apart
+    ff_cache_entry *e = search(&b->entries, &rec->name);
+
+    if (e == nullptr)
+    {
+        e = add_element_by_key(&b->entries, &brec->name);
+        init(&e->styles);
+    }
+
+    // compares the names too, ids of different styles with the same hash
+    // would find each other's fonts.
+    u32 *style_id = search(&b->style_ids, &rec->style);
+
+    if (style_id == nullptr)
+    {
+        const_string key = _ff_intern(&b->strings, rec->style);
+        style_id = add_element_by_key(&b->style_ids, &key);
+        *style_id = (u32)b->style_names.size;
+        *add_at_end(&b->style_names) = key;
+    }
+
+    brec->style = b->style_names.data[*style_id];
+
+    ff_cache_entry_style *st = _ff_find_style(e, *style_id);
+
+    if (st != nullptr)
+    {
+        /*
+        if (st->path != path)
+            tprint("  Warning: path mismatch in font %, style %: %, %\n", name, style, path, st->path);
+        */
+    }
+    else
+    {
+        ff_cache_entry_style *newstyle = add_at_end(&e->styles);
+        newstyle->style_id = *style_id;
+        newstyle->record = record_index;
+        newstyle->path = brec->path;
+    }
+}
+
+/* FONT FILE DOCUMENTATION
+
+If there are no fontconfig caches (minimal containers, NixOS, ...) or if
+ff_LoadFlags_FontDirectories is set, the font files in the standard font
+directories are read directly instead.
+Only the "name" and "cmap" tables of TrueType / OpenType fonts and
+collections are read, which is all that's needed for family and style names
+and coverage.
+Fonts are big-endian.
+
+https://learn.microsoft.com/en-us/typography/opentype/spec/otff
+https://learn.microsoft.com/en-us/typography/opentype/spec/name
+
+Font collections (.ttc) start with the tag 'ttcf', followed by a version (u32),
+the number of fonts (u32) and that many offsets (u32) to the table directory
+of each font within the file.
+A table directory starts with the sfnt version (u32), followed by the number
+of tables (u16), three u16 we don't care about, then the table records of
+16 bytes each: tag, checksum, offset (from the start of the file), length.
+
+The name table starts with format (u16), count (u16) and the offset of the
+string storage (u16, relative to the name table), followed by count name
+records of 12 bytes each: platform id, encoding id, language id, name id,
+length and offset (relative to the string storage), all u16.
+
+Name ids used here are 1 (family), 2 (subfamily, i.e. style), and their
+"typographic" variants 16 and 17, which are preferred if present because
+they group all styles of a family under the same name, like fontconfig does.
+Strings of platform 0 (Unicode) and 3 (Windows) are UTF-16BE, strings of
+platform 1 (Macintosh) are treated as ASCII.
+*/
+constexpr fixed_array _font_dirs = {
+    "$HOME/.local/share/fonts",
+    "$HOME/.fonts",
+    "/usr/local/share/fonts",
+    "/usr/share/fonts",
+    "/run/current-system/sw/share/X11/fonts" // NixOS
+};
+
+#define FF_MAX_FONT_DIR_DEPTH 8
+
+#define SFNT_TAG(A, B, C, D) (((u32)(A) << 24) | ((u32)(B) << 16) | ((u32)(C) << 8) | (u32)(D))
+#define SFNT_TAG_TTCF SFNT_TAG('t', 't', 'c', 'f')
+#define SFNT_TAG_NAME SFNT_TAG('n', 'a', 'm', 'e')
+#define SFNT_TAG_CMAP SFNT_TAG('c', 'm', 'a', 'p')
+
+#define SFNT_NAME_FAMILY             1
+#define SFNT_NAME_SUBFAMILY          2
+#define SFNT_NAME_TYPOGRAPHIC_FAMILY 16
+#define SFNT_NAME_TYPOGRAPHIC_SUBFAMILY 17
+
+#define SFNT_PLATFORM_UNICODE   0
+#define SFNT_PLATFORM_MACINTOSH 1
+#define SFNT_PLATFORM_WINDOWS   3
+
+#define SFNT_LANGUAGE_WINDOWS_EN_US 0x0409
+#define SFNT_LANGUAGE_MACINTOSH_EN  0
+
+static inline u16 _sfnt_u16(const u8 *p)
+{
+    return (u16)((p[0] << 8) | p[1]);
+}
+
+static inline u32 _sfnt_u32(const u8 *p)
+{
+    return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | (u32)p[3];
+}
+
+static bool _is_font_file(const_string filename)
+{
+    if (filename.size < 4 || filename.c_str[filename.size - 4] != '.')
+        return false;
+
+    char ext[3];
+
+    for (int i = 0; i < 3; ++i)
+    {
+        char c = filename.c_str[filename.size - 3 + i];
+
+        if (c >= 'A' && c <= 'Z')
+            c = (char)(c - 'A' + 'a');
+
+        ext[i] = c;
+    }
+
+    const_string e = to_const_string(ext, 3);
+
+    return e == "ttf"_cs || e == "otf"_cs || e == "ttc"_cs || e == "otc"_cs;
+}
+
+struct sfnt_name
+{
+    const u8 *data;
+    u16 length;
+    u16 platform;
+    int score;
+};
+
+// higher is better, 0 = unusable
+static int _sfnt_name_score(u16 platform, u16 encoding, u16 language)
+{
+    switch (platform)
+    {
+    case SFNT_PLATFORM_WINDOWS:
+        // 0 = symbol, 1 = unicode BMP, 10 = unicode full
+        if (encoding != 0 && encoding != 1 && encoding != 10)
+            return 0;
+
+        return language == SFNT_LANGUAGE_WINDOWS_EN_US ? 4 : 2;
+    case SFNT_PLATFORM_UNICODE:
+        return 3;
+    case SFNT_PLATFORM_MACINTOSH:
+        // 0 = roman
+        if (encoding != 0)
+            return 0;
+
+        return language == SFNT_LANGUAGE_MACINTOSH_EN ? 1 : 0;
+    default:
+        return 0;
+    }
+}
+
+static void _sfnt_append_utf8(string *out, u32 cp)
+{
+    char buf[4];
+    s64 n = 0;
+
+    if (cp < 0x80)
+        buf[n++] = (char)cp;
+    else if (cp < 0x800)
+    {
+        buf[n++] = (char)(0xc0 | (cp >> 6));
+        buf[n++] = (char)(0x80 | (cp & 0x3f));
+    }
+    else if (cp < 0x10000)
+    {
+        buf[n++] = (char)(0xe0 | (cp >> 12));
+        buf[n++] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        buf[n++] = (char)(0x80 | (cp & 0x3f));
+    }
+    else
+    {
+        buf[n++] = (char)(0xf0 | (cp >> 18));
+        buf[n++] = (char)(0x80 | ((cp >> 12) & 0x3f));
+        buf[n++] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        buf[n++] = (char)(0x80 | (cp & 0x3f));
+    }
+
+    string_append(out, to_const_string(buf, n));
+}
+
+static void _sfnt_append_name(string *out, const sfnt_name *name)
+{
+    const u8 *p = name->data;
+
+    if (name->platform == SFNT_PLATFORM_MACINTOSH)
+    {
+        for (u16 i = 0; i < name->length; ++i)
+            _sfnt_append_utf8(out, p[i] < 0x80 ? p[i] : '?');
+
+        return;
+    }
+
+    for (u16 i = 0; i + 1 < name->length; i += 2)
+    {
+        u32 cp = _sfnt_u16(p + i);
+
+        if (cp >= 0xd800 && cp < 0xdc00 && i + 3 < name->length)
+        {
+            u32 low = _sfnt_u16(p + i + 2);
+
+            if (low >= 0xdc00 && low < 0xe000)
+            {
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                i += 2;
+            }
+        }
+
+        if (cp == 0)
+            break;
+
+        _sfnt_append_utf8(out, cp);
+    }
+}
+
+// finds the table with the given tag of the font whose table directory starts at face_offset.
+static bool _sfnt_find_table(const u8 *data, s64 size, s64 face_offset, u32 tag, const u8 **table, s64 *table_size)
+{
+    if (face_offset < 0 || face_offset + 12 > size)
+        return false;
+
+    u16 table_count = _sfnt_u16(data + face_offset + 4);
+
+    if (face_offset + 12 + (s64)table_count * 16 > size)
+        return false;
+
+    for (u16 i = 0; i < table_count; ++i)
+    {
+        const u8 *rec = data + face_offset + 12 + i * 16;
+
+        if (_sfnt_u32(rec) != tag)
+            continue;
+
+        s64 offset = _sfnt_u32(rec + 8);
+        s64 length = _sfnt_u32(rec + 12);
+
+        if (offset + length > size)
+            return false;
+
+        *table = data + offset;
+        *table_size = length;
+        return true;
+    }
+
+    return false;
+}
+
+// reads the family and style names of the font whose table directory starts at face_offset.
+static bool _sfnt_read_face_names(const u8 *data, s64 size, s64 face_offset, sfnt_name *family, sfnt_name *style)
+{
+    const u8 *name_table = nullptr;
+    s64 name_table_size = 0;
+
+    if (!_sfnt_find_table(data, size, face_offset, SFNT_TAG_NAME, &name_table, &name_table_size)
+     || name_table_size < 6)
+        return false;
+
+    u16 count = _sfnt_u16(name_table + 2);
+    s64 storage_offset = _sfnt_u16(name_table + 4);
+
+    if (6 + (s64)count * 12 > name_table_size)
+        return false;
+
+    *family = {};
+    *style = {};
+
+    for (u16 i = 0; i < count; ++i)
+    {
+        const u8 *rec = name_table + 6 + i * 12;
+        u16 platform = _sfnt_u16(rec);
+        u16 encoding = _sfnt_u16(rec + 2);
+        u16 language = _sfnt_u16(rec + 4);
+        u16 name_id  = _sfnt_u16(rec + 6);
+        u16 length   = _sfnt_u16(rec + 8);
+        s64 offset   = storage_offset + _sfnt_u16(rec + 10);
+
+        if (length == 0 || offset + length > name_table_size)
+            continue;
+
+        sfnt_name *target = nullptr;
+        int score = _sfnt_name_score(platform, encoding, language);
+
+        if (score == 0)
+            continue;
+
+        switch (name_id)
+        {
+        case SFNT_NAME_FAMILY:                target = family; break;
+        case SFNT_NAME_SUBFAMILY:             target = style;  break;
+        case SFNT_NAME_TYPOGRAPHIC_FAMILY:    target = family; score += 10; break;
+        case SFNT_NAME_TYPOGRAPHIC_SUBFAMILY: target = style;  score += 10; break;
+        default: break;
+        }
+
+        if (target == nullptr || target->score >= score)
+            continue;
+
+        target->data = name_table + offset;
+        target->length = length;
+        target->platform = platform;
+        target->score = score;
+    }
+
+    return family->data != nullptr;
+}
+
+static int _compare_coverage_pages(const ff_coverage_page *lhs, const ff_coverage_page *rhs)
+{
+    return (lhs->page > rhs->page) - (lhs->page < rhs->page);
+}
+
+// sets the bit of codepoint in the pages of the current face, which start at first.
+// codepoints mostly come in ascending order, so new pages are usually at the end.
+static void _sfnt_cover(array<ff_coverage_page> *pages, s64 first, u32 codepoint)
+{
+    u32 page = codepoint >> 8;
+
+    if (page >= FF_COVERAGE_PAGE_COUNT)
+        return;
+
+    ff_coverage_page *pg = nullptr;
+
+    if (pages->size > first && pages->data[pages->size - 1].page >= page)
+    {
+        for (s64 i = pages->size - 1; i >= first; --i)
+            if (pages->data[i].page == page)
+            {
+                pg = pages->data + i;
+                break;
+            }
+    }
+
+    if (pg == nullptr)
+    {
+        pg = add_at_end(pages);
+        fill_memory(pg, 0);
+        pg->page = page;
+    }
+
+    pg->leaf.map[(codepoint >> 5) & 7] |= 1u << (codepoint & 31);
+}
+
+// higher is better, 0 = unusable
+static int _sfnt_cmap_score(u16 platform, u16 encoding, u16 format)
+{
+    if (format == 12)
+    {
+        if (platform == SFNT_PLATFORM_WINDOWS && encoding == 10) return 4;
+        if (platform == SFNT_PLATFORM_UNICODE) return 3;
+    }
+    else if (format == 4)
+    {
+        if (platform == SFNT_PLATFORM_WINDOWS && encoding == 1) return 2;
+        if (platform == SFNT_PLATFORM_UNICODE) return 2;
+        if (platform == SFNT_PLATFORM_WINDOWS && encoding == 0) return 1; // symbol
+    }
+
+    return 0;
+}
+
+/* Coverage of font files comes from the "cmap" table, which maps codepoints
+to glyphs. Only subtable formats 4 (BMP) and 12 (full range) are read, which
+all modern fonts have.
+https://learn.microsoft.com/en-us/typography/opentype/spec/cmap
+
+The cmap table has version (u16), number of subtables (u16) and then that many
+encoding records of platform id (u16), encoding id (u16) and offset (u32,
+relative to the cmap table) of the subtable. All subtables start with their
+format (u16).
+Codepoints that map to glyph 0 (missing glyph) are not covered.
+*/
+static void _sfnt_read_cmap_coverage(const u8 *data, s64 size, s64 face_offset, array<ff_coverage_page> *pages)
+{
+    const u8 *cmap = nullptr;
+    s64 cmap_size = 0;
+
+    if (!_sfnt_find_table(data, size, face_offset, SFNT_TAG_CMAP, &cmap, &cmap_size) || cmap_size < 4)
+        return;
+
+    u16 subtable_count = _sfnt_u16(cmap + 2);
+
+    if (4 + (s64)subtable_count * 8 > cmap_size)
+        return;
+
+    const u8 *sub = nullptr;
+    s64 sub_size = 0;
+    int best_score = 0;
+
+    for (u16 i = 0; i < subtable_count; ++i)
+    {
+        const u8 *rec = cmap + 4 + i * 8;
+        s64 offset = _sfnt_u32(rec + 4);
+
+        if (offset + 4 > cmap_size)
+            continue;
+
+        int score = _sfnt_cmap_score(_sfnt_u16(rec), _sfnt_u16(rec + 2), _sfnt_u16(cmap + offset));
+
+        if (score <= best_score)
+            continue;
+
+        best_score = score;
+        sub = cmap + offset;
+        sub_size = cmap_size - offset;
+    }
+
+    if (sub == nullptr)
+        return;
+
+    s64 first = pages->size;
+
+    if (_sfnt_u16(sub) == 12)
+    {
+        if (sub_size < 16)
+            return;
+
+        u32 group_count = _sfnt_u32(sub + 12);
+
+        if (16 + (s64)group_count * 12 > sub_size)
+            return;
+
+        // guards against absurd fonts with many overlapping groups
+        s64 budget = 2 * FF_COVERAGE_PAGE_COUNT * 256;
+
+        for (u32 g = 0; g < group_count && budget > 0; ++g)
+        {
+            const u8 *group = sub + 16 + g * 12;
+            u32 start = _sfnt_u32(group);
+            u32 end = _sfnt_u32(group + 4);
+            u32 start_glyph = _sfnt_u32(group + 8);
+
+            if (end >= FF_COVERAGE_PAGE_COUNT * 256)
+                end = FF_COVERAGE_PAGE_COUNT * 256 - 1;
+
+            for (u32 c = start; c <= end && budget > 0; ++c, --budget)
+                if (start_glyph + (c - start) != 0)
+                    _sfnt_cover(pages, first, c);
+        }
+    }
+    else
+    {
+        // format 4
+        if (sub_size < 14)
+            return;
+
+        s64 seg_count_x2 = _sfnt_u16(sub + 6);
+        s64 seg_count = seg_count_x2 / 2;
+
+        if (16 + seg_count_x2 * 4 > sub_size)
+            return;
+
+        const u8 *end_codes = sub + 14;
+        const u8 *start_codes = end_codes + seg_count_x2 + 2;
+        const u8 *id_deltas = start_codes + seg_count_x2;
+        const u8 *id_range_offsets = id_deltas + seg_count_x2;
+
+        for (s64 i = 0; i < seg_count; ++i)
+        {
+            u32 start = _sfnt_u16(start_codes + i * 2);
+            u32 end = _sfnt_u16(end_codes + i * 2);
+            u16 delta = _sfnt_u16(id_deltas + i * 2);
+            u16 range_offset = _sfnt_u16(id_range_offsets + i * 2);
+
+            if (start == 0xffff)
+                continue;
+
+            for (u32 c = start; c <= end; ++c)
+            {
+                u16 glyph = 0;
+
+                if (range_offset == 0)
+                    glyph = (u16)(c + delta);
+                else
+                {
+                    const u8 *p = id_range_offsets + i * 2 + range_offset + (c - start) * 2;
+
+                    if (p + 2 > sub + sub_size)
+                        break;
+
+                    glyph = _sfnt_u16(p);
+
+                    if (glyph != 0)
+                        glyph = (u16)(glyph + delta);
+                }
+
+                if (glyph != 0)
+                    _sfnt_cover(pages, first, c);
+            }
+        }
+    }
+
+    if (pages->size - first > 1)
+        sort(pages->data + first, pages->size - first, _compare_coverage_pages);
+}
+
+struct ff_sfnt_face
+{
+    s64 name_offset;
+    s64 name_size;
+    s64 style_offset;
+    s64 style_size;
+    u32 first_page;
+    u32 page_count;
+};
+
+static ff_parse_result _parse_font_file(const_string filepath, ff_parsed_file *out)
+{
+    if (!_map_file(filepath.c_str, &out->file))
+        return ff_Parse_CouldNotRead;
+
+    // names are copied, no need to keep the font mapped
+    defer { _unmap_file(&out->file); };
+
+    const u8 *data = (const u8*)out->file.data;
+    s64 size = out->file.size;
+
+    if (size < 12)
+        return ff_Parse_Invalid;
+
+    u32 face_count = 1;
+    bool collection = _sfnt_u32(data) == SFNT_TAG_TTCF;
+
+    if (collection)
+    {
+        face_count = _sfnt_u32(data + 8);
+
+        if (12 + (s64)face_count * 4 > size)
+            return ff_Parse_Invalid;
+    }
+
+    // names are appended to out->names, which may move while appending, so
+    // only offsets are kept until all faces are read.
+    array<ff_sfnt_face> faces{};
+    faces.allocator = out->fonts.allocator;
+    defer { free(&faces); };
+
+    for (u32 i = 0; i < face_count; ++i)
+    {
+        s64 face_offset = collection ? (s64)_sfnt_u32(data + 12 + i * 4) : 0;
+        sfnt_name family{};
+        sfnt_name style{};
+
+        if (!_sfnt_read_face_names(data, size, face_offset, &family, &style))
+            continue;
+
+        ff_sfnt_face *face = add_at_end(&faces);
+        face->name_offset = out->names.size;
+        _sfnt_append_name(&out->names, &family);
+        face->name_size = out->names.size - face->name_offset;
+
+        face->style_offset = out->names.size;
+
+        if (style.data != nullptr)
+            _sfnt_append_name(&out->names, &style);
+
+        face->style_size = out->names.size - face->style_offset;
+
+        if (face->name_size == 0)
+        {
+            faces.size -= 1;
+            continue;
+        }
+
+        face->first_page = (u32)out->pages.size;
+        _sfnt_read_cmap_coverage(data, size, face_offset, &out->pages);
+        face->page_count = (u32)(out->pages.size - face->first_page);
+    }
+
+    if (faces.size == 0)
+        return face_count > 0 ? ff_Parse_Invalid : ff_Parse_Ok;
+
+    for_array(face, &faces)
+    {
+        ff_font_record *rec = add_at_end(&out->fonts);
+        rec->name  = to_const_string(out->names.data + face->name_offset, face->name_size);
+        rec->style = to_const_string(out->names.data + face->style_offset, face->style_size);
+        rec->path  = filepath;
+        rec->first_page = face->first_page;
+        rec->page_count = face->page_count;
+    }
+
+    return ff_Parse_Ok;
+}
+
+static int _compare_string_paths(const string *lhs, const string *rhs)
+{
+    return _ff_compare_strings(to_const_string(*lhs), to_const_string(*rhs));
+}
+
+// recursively finds font files in dir. like _find_cache_files, files of a
+// single directory are sorted by name, subdirectories are visited after the
+// files of a directory, also sorted by name.
+static void _find_font_files_in_dir(const_string dir, array<ff_cache_source> *font_files, ::allocator allocator, int depth)
+{
+    if (depth > FF_MAX_FONT_DIR_DEPTH)
+        return;
+
+    DIR *d = opendir(dir.c_str);
+
+    if (d == nullptr)
+        return;
+
+    s64 first = font_files->size;
+    array<string> subdirs{};
+    subdirs.allocator = allocator;
+    defer { free<true>(&subdirs); };
+
+    string path{};
+    path.allocator = allocator;
+    defer { free(&path); };
+
+    struct statx st{};
+
+    for (dirent *ent = readdir(d); ent != nullptr; ent = readdir(d))
+    {
+        const_string filename = to_const_string((const char*)ent->d_name);
+
+        // also skips . and ..
+        if (filename.size == 0 || filename.c_str[0] == '.')
+            continue;
+
+        string_set(&path, dir);
+        string_append(&path, "/");
+        string_append(&path, filename);
+
+        // follows symlinks
+        if (statx(AT_FDCWD, path.data, 0, STATX_TYPE | STATX_SIZE | STATX_MTIME, &st) != 0)
+            continue;
+
+        if (S_ISDIR(st.stx_mode))
+        {
+            string *subdir = add_at_end(&subdirs);
+            *subdir = {};
+            subdir->allocator = allocator;
+            string_copy(to_const_string(path), subdir);
+            continue;
+        }
+
+        if (!S_ISREG(st.stx_mode) || !_is_font_file(filename))
+            continue;
+
+        ff_cache_source *src = add_at_end(font_files);
+        fill_memory(src, 0);
+        src->path.allocator = allocator;
+        string_copy(to_const_string(path), &src->path);
+        src->size = (s64)st.stx_size;
+        src->mtime_sec = (s64)st.stx_mtime.tv_sec;
+        src->mtime_nsec = (s64)st.stx_mtime.tv_nsec;
+    }
+
+    closedir(d);
+
+    if (font_files->size - first > 1)
+        sort(font_files->data + first, font_files->size - first, _compare_cache_sources);
+
+    if (subdirs.size > 1)
+        sort(subdirs.data, subdirs.size, _compare_string_paths);
+
+    for_array(subdir, &subdirs)
+        _find_font_files_in_dir(to_const_string(*subdir), font_files, allocator, depth + 1);
+}
+
+static bool _find_font_files(array<ff_cache_source> *font_files, ::allocator allocator)
+{
+    string dir{};
+    dir.allocator = allocator;
+    defer { free(&dir); };
+
+    for_array(pdir, &_font_dirs)
+    {
+        string_set(&dir, *pdir);
+        resolve_environment_variables(&dir, true);
+        fill_memory(dir.data + dir.size, 0, dir.reserved_size - dir.size);
+
+        _find_font_files_in_dir(to_const_string(dir), font_files, allocator, 0);
+    }
+
+    return font_files->size > 0;
+}
+
+// indices are the indices of the source files to parse, all files if nullptr.
+struct ff_parse_job
+{
+    array<ff_cache_source> *source_files;
+    ff_parsed_file *parsed_files;
+    ff_parse_function parse;
+    s64 *indices;
+};
+
+static void _ff_parse_job_function(s64 index, void *userdata)
+{
+    ff_parse_job *job = (ff_parse_job*)userdata;
+
+    if (job->indices != nullptr)
+        index = job->indices[index];
+
+    ff_parsed_file *pfile = job->parsed_files + index;
+
+    pfile->result = job->parse(to_const_string(job->source_files->data[index].path), pfile);
+    pfile->parsed = true;
+}
+
+static bool _find_fontconfig_cache_files(array<ff_cache_source> *cache_files, ::allocator allocator)
+{
+    string fc_path{};
+    defer { free(&fc_path); };
+    struct statx st{};
+    bool any_fontconfig_path_found = false;
+
+    for_array(ppath, &_fontconfig_cache_dirs)
+    {
+        string_set(&fc_path, *ppath);
+        resolve_environment_variables(&fc_path, true);
+        fill_memory(fc_path.data + fc_path.size, 0, fc_path.reserved_size - fc_path.size);
+
+        if (statx(AT_FDCWD, fc_path.data, 0, STATX_TYPE, &st) != 0)
+            continue;
+
+        if (!S_ISDIR(st.stx_mode))
+            continue;
+
+        any_fontconfig_path_found = true;
+        _find_cache_files(to_const_string(fc_path), cache_files, allocator);
+    }
+
+    return any_fontconfig_path_found && cache_files->size > 0;
+}
+
+/* IMAGE DOCUMENTATION
+
+Once all fonts are collected in the builder, they are flattened into a single
+block of memory, the "image", which is what all lookups and the iterator use.
+The image only contains offsets (relative to the start of the image), never
+pointers, so the exact same bytes can be written to disk and mapped again
+on the next start ("snapshot"), without parsing anything.
+
+Layout, each table aligned to 8 bytes:
+
+    ff_image_header
+    ff_image_family[family_count]   families, sorted by name (bytewise), so
+                                    prefix lookups can binary search
+    ff_image_style[style_count]     styles of all families, each family owns
+                                    style_count styles starting at first_style
+    u32[slot_count]                 open addressing hash table of families by
+                                    name, family index + 1, 0 = empty slot
+    ff_image_style_name[style_name_count]
+                                    all distinct style names, a style refers to
+                                    its name by index (style id)
+    u32[style_slot_count]           open addressing hash table of style names,
+                                    style id + 1, 0 = empty slot
+    ff_image_source[source_count]   the fontconfig cache files the image was
+                                    built from, used to validate snapshots
+    ff_image_record[record_count]   all fonts of all sources in source order,
+                                    including ones shadowed by an earlier
+                                    source, a source owns record_count records
+                                    starting at first_record. used by
+                                    ff_cache_refresh to rebuild the image
+                                    without parsing unchanged sources again
+    ff_coverage_leaf[leaf_count]    all distinct coverage leaves, see Coverage
+    ff_coverage_ref[page_count]     the pages of all records, a record owns
+                                    page_count pages starting at first_page,
+                                    sorted by page. styles refer to the pages
+                                    of the record they came from
+    u32[FF_COVERAGE_PAGE_COUNT + 1] coverage index: the styles that have page
+    u32[coverage_style_count]       p are coverage_styles[index[p]] up to
+                                    coverage_styles[index[p + 1]], in the
+                                    order of the styles
+    char[strings_size]              all strings, nul-terminated, every distinct
+                                    string only once (see String arena)
+
+String members (name, path) are offsets into the strings.
+The hash function is fixed (FNV-1a) because it is stored in snapshots.
+
+An exact lookup hashes the family name and the style name once each, the
+style of the family is then found by comparing style ids.
+A coverage lookup only looks at the styles that have the page of the
+codepoint, using the coverage index.
+*/
+#define FF_IMAGE_MAGIC   0x46464349 // "ICFF"
+#define FF_IMAGE_VERSION 5
+
+struct ff_image_header
+{
+    u32 magic;
+    u32 version;
+    u64 size;
+    u32 family_count;
+    u32 style_count;
+    u32 slot_count;
+    u32 style_name_count;
+    u32 style_slot_count;
+    u32 source_count;
+    u32 record_count;
+    u32 leaf_count;
+    u32 page_count;
+    u32 coverage_style_count;
+    u32 families_offset;
+    u32 styles_offset;
+    u32 slots_offset;
+    u32 style_names_offset;
+    u32 style_slots_offset;
+    u32 sources_offset;
+    u32 records_offset;
+    u32 leaves_offset;
+    u32 pages_offset;
+    u32 coverage_index_offset;
+    u32 coverage_styles_offset;
+    u32 strings_offset;
+    u32 strings_size;
+};
+
+struct ff_image_family
+{
+    u64 hash;
+    u32 name;
+    u32 name_size;
+    u32 first_style;
+    u32 style_count;
+};
+
+struct ff_image_style
+{
+    u32 style_id;
+    u32 path;
+    u32 first_page;
+    u32 page_count;
+};
+
+struct ff_image_style_name
+{
+    u64 hash;
+    u32 name;
+    u32 name_size;
+};
+
+struct ff_image_source
+{
+    u32 path;
+    u32 path_size;
+    u32 first_record;
+    u32 record_count;
+    s64 size;
+    s64 mtime_sec;
+    s64 mtime_nsec;
+};
+
+struct ff_image_record
+{
+    u32 name;
+    u32 name_size;
+    u32 style;
+    u32 style_size;
+    u32 path;
+    u32 path_size;
+    u32 first_page;
+    u32 page_count;
+};
+
+static inline const ff_image_family *_ff_image_families(const ff_image_header *img)
+{
+    return (const ff_image_family*)((const char*)img + img->families_offset);
+}
+
+static inline const ff_image_style *_ff_image_styles(const ff_image_header *img)
+{
+    return (const ff_image_style*)((const char*)img + img->styles_offset);
+}
+
+static inline const u32 *_ff_image_slots(const ff_image_header *img)
+{
+    return (const u32*)((const char*)img + img->slots_offset);
+}
+
+static inline const ff_image_style_name *_ff_image_style_names(const ff_image_header *img)
+{
+    return (const ff_image_style_name*)((const char*)img + img->style_names_offset);
+}
+
+static inline const u32 *_ff_image_style_slots(const ff_image_header *img)
+{
+    return (const u32*)((const char*)img + img->style_slots_offset);
+}
+
+static inline const ff_image_source *_ff_image_sources(const ff_image_header *img)
+{
+    return (const ff_image_source*)((const char*)img + img->sources_offset);
+}
+
+static inline const ff_image_record *_ff_image_records(const ff_image_header *img)
+{
+    return (const ff_image_record*)((const char*)img + img->records_offset);
+}
+
+static inline const ff_coverage_leaf *_ff_image_leaves(const ff_image_header *img)
+{
+    return (const ff_coverage_leaf*)((const char*)img + img->leaves_offset);
+}
+
+static inline const ff_coverage_ref *_ff_image_pages(const ff_image_header *img)
+{
+    return (const ff_coverage_ref*)((const char*)img + img->pages_offset);
+}
+
+static inline const u32 *_ff_image_coverage_index(const ff_image_header *img)
+{
+    return (const u32*)((const char*)img + img->coverage_index_offset);
+}
+
+static inline const u32 *_ff_image_coverage_styles(const ff_image_header *img)
+{
+    return (const u32*)((const char*)img + img->coverage_styles_offset);
+}
+
+static inline const char *_ff_image_string(const ff_image_header *img, u32 offset)
+{
+    return (const char*)img + img->strings_offset + offset;
+}
+
+static inline const_string _ff_image_const_string(const ff_image_header *img, u32 offset, u32 size)
+{
+    return to_const_string(_ff_image_string(img, offset), size);
+}
+
+static inline u64 _ff_align(u64 x)
+{
+    return (x + 7) & ~(u64)7;
+}
+
+static u32 _ff_slot_count(u32 family_count)
+{
+    // at most half full
+    u32 ret = 16;
+
+    while (ret < family_count * 2)
+        ret <<= 1;
+
+    return ret;
+}
+
+// takes the fonts of source files that didn't change since previous was
+// built from the records of previous instead of parsing the files again.
+// returns the number of files that still have to be parsed, their indices
+// are written to indices.
+static s64 _ff_reuse_records(const ff_image_header *previous, array<ff_cache_source> *source_files, ff_parsed_file *parsed_files, s64 *indices)
+{
+    hash_table<const_string, u32> previous_sources{};
+    init(&previous_sources);
+    defer { free(&previous_sources); };
+
+    const ff_image_source *isrcs = _ff_image_sources(previous);
+    const ff_image_record *irecs = _ff_image_records(previous);
+    const ff_coverage_ref *ipages = _ff_image_pages(previous);
+    const ff_coverage_leaf *ileaves = _ff_image_leaves(previous);
+
+    for (u32 i = 0; i < previous->source_count; ++i)
+    {
+        const_string path = _ff_image_const_string(previous, isrcs[i].path, isrcs[i].path_size);
+        *add_element_by_key(&previous_sources, &path) = i;
+    }
+
+    s64 parse_count = 0;
+
+    for (s64 i = 0; i < source_files->size; ++i)
+    {
+        ff_cache_source *src = source_files->data + i;
+        const_string path = to_const_string(src->path);
+        u32 *prev_index = search_by_hash(&previous_sources, hash(path));
+        const ff_image_source *isrc = prev_index != nullptr ? isrcs + *prev_index : nullptr;
+
+        if (isrc == nullptr
+         || !(_ff_image_const_string(previous, isrc->path, isrc->path_size) == path)
+         || isrc->size != src->size
+         || isrc->mtime_sec != src->mtime_sec
+         || isrc->mtime_nsec != src->mtime_nsec)
+        {
+            indices[parse_count] = i;
+            parse_count += 1;
+            continue;
+        }
+
+        ff_parsed_file *pfile = parsed_files + i;
+        pfile->result = ff_Parse_Ok;
+
+        for (u32 r = isrc->first_record; r < isrc->first_record + isrc->record_count; ++r)
+        {
+            const ff_image_record *irec = irecs + r;
+            ff_font_record *rec = add_at_end(&pfile->fonts);
+            rec->name  = _ff_image_const_string(previous, irec->name, irec->name_size);
+            rec->style = _ff_image_const_string(previous, irec->style, irec->style_size);
+            rec->path  = _ff_image_const_string(previous, irec->path, irec->path_size);
+            rec->first_page = (u32)pfile->pages.size;
+            rec->page_count = irec->page_count;
+
+            for (u32 pg = irec->first_page; pg < irec->first_page + irec->page_count; ++pg)
+            {
+                ff_coverage_page *page = add_at_end(&pfile->pages);
+                page->page = ipages[pg].page;
+                page->leaf = ileaves[ipages[pg].leaf];
+            }
+        }
+    }
+
+    return parse_count;
+}
+
+// parses all source files (fontconfig cache files or font files) and adds
+// their fonts to the builder. if previous is not nullptr, only files that
+// changed since previous was built are parsed.
+static bool _load_source_files(ff_cache_builder *b, array<ff_cache_source> *source_files, ff_parse_function parse, ff_cache_stats *stats, const ff_image_header *previous = nullptr)
+{
+    s64 file_count = source_files->size;
+    ff_parsed_file *parsed_files = (ff_parsed_file*)allocator_alloc(b->allocator, sizeof(ff_parsed_file) * file_count);
+    defer { allocator_dealloc(b->allocator, parsed_files, sizeof(ff_parsed_file) * file_count); };
+
+    for (s64 i = 0; i < file_count; ++i)
+    {
+        fill_memory(parsed_files + i, 0);
+        parsed_files[i].fonts.allocator = b->allocator;
+        parsed_files[i].pages.allocator = b->allocator;
+        parsed_files[i].names.allocator = b->allocator;
+    }
+
+    ff_parse_job job{};
+    job.source_files = source_files;
+    job.parsed_files = parsed_files;
+    job.parse = parse;
+
+    s64 parse_count = file_count;
+    s64 *indices = nullptr;
+
+    if (previous != nullptr)
+    {
+        indices = (s64*)allocator_alloc(b->allocator, sizeof(s64) * (file_count + 1));
+        parse_count = _ff_reuse_records(previous, source_files, parsed_files, indices);
+        job.indices = indices;
+    }
+
+    defer { if (indices != nullptr) allocator_dealloc(b->allocator, indices, sizeof(s64) * (file_count + 1)); };
+
+    timespan start;
+    get_time(&start);
+
+    _ff_parallel_for(parse_count, _ff_parse_job_function, &job);
+
+    stats->parse_seconds = _ff_seconds_since(&start);
+    stats->files_parsed = (int)parse_count;
+
+    // size the string arena and the leaf table for the worst case of no
+    // duplicates at all, also includes the paths of the source files, see
+    // _ff_build_image.
+    s64 string_bytes = 0;
+    s64 string_count = 0;
+    s64 page_count = 0;
+
+    for (s64 i = 0; i < file_count; ++i)
+    {
+        string_bytes += source_files->data[i].path.size + 1;
+        string_count += 1;
+
+        page_count += parsed_files[i].pages.size;
+
+        stats->bytes_allocated += parsed_files[i].fonts.reserved_size * (s64)sizeof(ff_font_record)
+                                + parsed_files[i].pages.reserved_size * (s64)sizeof(ff_coverage_page)
+                                + parsed_files[i].names.reserved_size;
+
+        for_array(rec, &parsed_files[i].fonts)
+        {
+            string_bytes += rec->name.size + rec->style.size + rec->path.size + 3;
+            string_count += 3;
+        }
+    }
+
+    if (!init(&b->strings, string_bytes, string_count, b->allocator)
+     || !init(&b->leaves, page_count, b->allocator)
+     || !reserve(&b->pages, page_count))
+    {
+        for (s64 i = 0; i < file_count; ++i)
+            free(parsed_files + i);
+
+        return false;
+    }
+
+    get_time(&start);
+
+    // merge in the order the files were found
+    for (s64 i = 0; i < file_count; ++i)
+    {
+        ff_parsed_file *pfile = parsed_files + i;
+        ff_cache_source *src = source_files->data + i;
+        const_string filepath = to_const_string(src->path);
+        src->first_record = (u32)b->records.size;
+
+        if (pfile->parsed)
+            stats->bytes_read += src->size;
+
+        switch (pfile->result)
+        {
+        case ff_Parse_CouldNotRead:
+            tprint("  could not read %\n", filepath);
+            stats->files_failed += 1;
+            break;
+        case ff_Parse_Invalid:
+            if (parse == _parse_font_file)
+                tprint("  invalid font file: %\n", filepath);
+            else
+                tprint("  invalid fontconfig cache: %\n", filepath);
+            stats->files_failed += 1;
+            break;
+        case ff_Parse_InvalidMagic:
+            tprint("  invalid magic number % in file: %\n", pfile->magic, filepath);
+            stats->files_skipped += 1;
+            break;
+        case ff_Parse_SkippedVersion:
+            // tprint("  skipping version in file: %\n", filepath);
+            stats->files_skipped += 1;
+            break;
+        case ff_Parse_Ok:
+            for_array(rec, &pfile->fonts)
+                _ff_add_font(b, rec, pfile->pages.data);
+            break;
+        }
+
+        src->record_count = (u32)(b->records.size - src->first_record);
+        free(pfile);
+    }
+
+    stats->insert_seconds = _ff_seconds_since(&start);
+
+    return true;
+}
+
+// bytes of everything the builder allocated, not exact for the hash tables.
+static s64 _ff_builder_bytes(const ff_cache_builder *b)
+{
+    s64 ret = b->strings.size + (s64)sizeof(ff_string_arena_slot) * b->strings.slot_count
+            + b->leaves.size * (s64)sizeof(ff_coverage_leaf) + (s64)sizeof(u32) * b->leaves.slot_count
+            + b->records.reserved_size * (s64)sizeof(ff_font_record)
+            + b->pages.reserved_size * (s64)sizeof(ff_coverage_ref)
+            + b->style_names.reserved_size * (s64)sizeof(const_string)
+            + b->style_ids.data.reserved_size * (s64)sizeof(b->style_ids.data.data[0])
+            + b->entries.data.reserved_size * (s64)sizeof(b->entries.data.data[0]);
+
+    for_array(hentry, &b->entries.data)
+        if (hentry->hash >= FIRST_HASH)
+            ret += hentry->value.styles.reserved_size * (s64)sizeof(ff_cache_entry_style);
+
+    return ret;
+}
+
+struct ff_sorted_family
+{
+    const_string name;
+    ff_cache_entry *entry;
+};
+
+static int _compare_sorted_families(const ff_sorted_family *lhs, const ff_sorted_family *rhs)
+{
+    return _ff_compare_strings(lhs->name, rhs->name);
+}
+
+static ff_image_header *_ff_build_image(ff_cache_builder *b, array<ff_cache_source> *sources, ::allocator a)
+{
+    u64 family_count = 0;
+    u64 style_count = 0;
+    u64 coverage_style_count = 0;
+
+    for_array(hentry, &b->entries.data)
+    {
+        if (hentry->hash < FIRST_HASH)
+            continue;
+
+        family_count += 1;
+        style_count += hentry->value.styles.size;
+
+        for_array(st, &hentry->value.styles)
+            coverage_style_count += b->records.data[st->record].page_count;
+    }
+
+    ff_sorted_family *sorted = (ff_sorted_family*)allocator_alloc(a, sizeof(ff_sorted_family) * (family_count + 1));
+    defer { allocator_dealloc(a, sorted, sizeof(ff_sorted_family) * (family_count + 1)); };
+
+    {
+        u64 i = 0;
+
+        for_array(hentry, &b->entries.data)
+        {
+            if (hentry->hash < FIRST_HASH)
+                continue;
+
+            sorted[i].name = hentry->key;
+            sorted[i].entry = &hentry->value;
+            i += 1;
+        }
+
+        if (family_count > 1)
+            sort(sorted, (s64)family_count, _compare_sorted_families);
+    }
+
+    // space for these was reserved when the arena was created
+    ff_string_arena *arena = &b->strings;
+    u32 *source_paths = (u32*)allocator_alloc(a, sizeof(u32) * (sources->size + 1));
+    defer { allocator_dealloc(a, source_paths, sizeof(u32) * (sources->size + 1)); };
+
+    for (s64 i = 0; i < sources->size; ++i)
+        source_paths[i] = _ff_arena_offset(arena, _ff_intern(arena, to_const_string(sources->data[i].path)));
+
+    u64 strings_size = (u64)arena->used;
+
+    u32 slot_count = _ff_slot_count((u32)family_count);
+    u32 style_name_count = (u32)b->style_names.size;
+    u32 style_slot_count = _ff_slot_count(style_name_count);
+
+    u64 families_offset    = _ff_align(sizeof(ff_image_header));
+    u64 styles_offset      = _ff_align(families_offset + family_count * sizeof(ff_image_family));
+    u64 slots_offset       = _ff_align(styles_offset + style_count * sizeof(ff_image_style));
+    u64 style_names_offset = _ff_align(slots_offset + slot_count * sizeof(u32));
+    u64 style_slots_offset = _ff_align(style_names_offset + style_name_count * sizeof(ff_image_style_name));
+    u64 sources_offset     = _ff_align(style_slots_offset + style_slot_count * sizeof(u32));
+    u64 records_offset     = _ff_align(sources_offset + sources->size * sizeof(ff_image_source));
+    u64 leaves_offset      = _ff_align(records_offset + b->records.size * sizeof(ff_image_record));
+    u64 pages_offset       = _ff_align(leaves_offset + b->leaves.used * sizeof(ff_coverage_leaf));
+    u64 coverage_index_offset  = _ff_align(pages_offset + b->pages.size * sizeof(ff_coverage_ref));
+    u64 coverage_styles_offset = _ff_align(coverage_index_offset + (FF_COVERAGE_PAGE_COUNT + 1) * sizeof(u32));
+    u64 strings_offset     = _ff_align(coverage_styles_offset + coverage_style_count * sizeof(u32));
+    u64 total_size         = _ff_align(strings_offset + strings_size);
+
+    if (total_size > 0xffffffffull)
+    {
+        tprint("Error: font cache too large\n");
+        return nullptr;
+    }
+
+    char *data = (char*)allocator_alloc(a, total_size);
+
+    if (data == nullptr)
+        return nullptr;
+
+    fill_memory(data, 0, total_size);
+
+    ff_image_header *img = (ff_image_header*)data;
+    img->magic = FF_IMAGE_MAGIC;
+    img->version = FF_IMAGE_VERSION;
+    img->size = total_size;
+    img->family_count = (u32)family_count;
+    img->style_count = (u32)style_count;
+    img->slot_count = slot_count;
+    img->style_name_count = style_name_count;
+    img->style_slot_count = style_slot_count;
+    img->source_count = (u32)sources->size;
+    img->record_count = (u32)b->records.size;
+    img->leaf_count = (u32)b->leaves.used;
+    img->page_count = (u32)b->pages.size;
+    img->coverage_style_count = (u32)coverage_style_count;
+    img->families_offset = (u32)families_offset;
+    img->styles_offset = (u32)styles_offset;
+    img->slots_offset = (u32)slots_offset;
+    img->style_names_offset = (u32)style_names_offset;
+    img->style_slots_offset = (u32)style_slots_offset;
+    img->sources_offset = (u32)sources_offset;
+    img->records_offset = (u32)records_offset;
+    img->leaves_offset = (u32)leaves_offset;
+    img->pages_offset = (u32)pages_offset;
+    img->coverage_index_offset = (u32)coverage_index_offset;
+    img->coverage_styles_offset = (u32)coverage_styles_offset;
+    img->strings_offset = (u32)strings_offset;
+
+    ff_image_family *families = (ff_image_family*)(data + families_offset);
+    ff_image_style *styles = (ff_image_style*)(data + styles_offset);
+    u32 *slots = (u32*)(data + slots_offset);
+    ff_image_style_name *style_names = (ff_image_style_name*)(data + style_names_offset);
+    u32 *style_slots = (u32*)(data + style_slots_offset);
+    ff_image_source *img_sources = (ff_image_source*)(data + sources_offset);
+    ff_image_record *img_records = (ff_image_record*)(data + records_offset);
+    u32 *coverage_index = (u32*)(data + coverage_index_offset);
+    u32 *coverage_styles = (u32*)(data + coverage_styles_offset);
+
+    if (b->leaves.used > 0)
+        copy_memory(b->leaves.leaves, data + leaves_offset, b->leaves.used * sizeof(ff_coverage_leaf));
+
+    if (b->pages.size > 0)
+        copy_memory(b->pages.data, data + pages_offset, b->pages.size * sizeof(ff_coverage_ref));
+
+    copy_memory(arena->data, data + strings_offset, arena->used);
+    img->strings_size = (u32)arena->used;
+
+    u32 family_index = 0;
+    u32 style_index = 0;
+    u32 mask = slot_count - 1;
+
+    for (u64 i = 0; i < family_count; ++i)
+    {
+        const_string name = sorted[i].name;
+        ff_cache_entry *entry = sorted[i].entry;
+        ff_image_family *fam = families + family_index;
+        fam->hash = _ff_hash(name);
+        fam->name = _ff_arena_offset(arena, name);
+        fam->name_size = (u32)name.size;
+        fam->first_style = style_index;
+        fam->style_count = (u32)entry->styles.size;
+
+        for_array(st, &entry->styles)
+        {
+            const ff_font_record *rec = b->records.data + st->record;
+            ff_image_style *ist = styles + style_index;
+            ist->style_id = st->style_id;
+            ist->path = _ff_arena_offset(arena, st->path);
+            ist->first_page = rec->first_page;
+            ist->page_count = rec->page_count;
+            style_index += 1;
+
+            // counts first, turned into offsets below
+            for (u32 pg = 0; pg < rec->page_count; ++pg)
+                coverage_index[b->pages.data[rec->first_page + pg].page + 1] += 1;
+        }
+
+        u32 slot = (u32)fam->hash & mask;
+
+        while (slots[slot] != 0)
+            slot = (slot + 1) & mask;
+
+        slots[slot] = family_index + 1;
+        family_index += 1;
+    }
+
+    u32 style_mask = style_slot_count - 1;
+
+    for (u32 i = 0; i < style_name_count; ++i)
+    {
+        const_string name = b->style_names.data[i];
+        ff_image_style_name *sn = style_names + i;
+        sn->hash = _ff_hash(name);
+        sn->name = _ff_arena_offset(arena, name);
+        sn->name_size = (u32)name.size;
+
+        u32 slot = (u32)sn->hash & style_mask;
+
+        while (style_slots[slot] != 0)
+            slot = (slot + 1) & style_mask;
+
+        style_slots[slot] = i + 1;
+    }
+
+    for (s64 i = 0; i < sources->size; ++i)
+    {
+        ff_cache_source *src = sources->data + i;
+        ff_image_source *isrc = img_sources + i;
+        isrc->path = source_paths[i];
+        isrc->path_size = (u32)src->path.size;
+        isrc->first_record = src->first_record;
+        isrc->record_count = src->record_count;
+        isrc->size = src->size;
+        isrc->mtime_sec = src->mtime_sec;
+        isrc->mtime_nsec = src->mtime_nsec;
+    }
+
+    for (s64 i = 0; i < b->records.size; ++i)
+    {
+        ff_font_record *rec = b->records.data + i;
+        ff_image_record *irec = img_records + i;
+        irec->name = _ff_arena_offset(arena, rec->name);
+        irec->name_size = (u32)rec->name.size;
+        irec->style = _ff_arena_offset(arena, rec->style);
+        irec->style_size = (u32)rec->style.size;
+        irec->path = _ff_arena_offset(arena, rec->path);
+        irec->path_size = (u32)rec->path.size;
+        irec->first_page = rec->first_page;
+        irec->page_count = rec->page_count;
+    }
+
+    for (u32 pg = 0; pg < FF_COVERAGE_PAGE_COUNT; ++pg)
+        coverage_index[pg + 1] += coverage_index[pg];
+
+    {
+        // coverage_index[p] is the next free index of page p while filling,
+        // and the start of page p + 1 afterwards, so it's shifted back.
+        u32 *next = coverage_index;
+
+        for (u32 i = 0; i < style_index; ++i)
+        {
+            const ff_image_style *ist = styles + i;
+
+            for (u32 pg = 0; pg < ist->page_count; ++pg)
+            {
+                u32 page = b->pages.data[ist->first_page + pg].page;
+                coverage_styles[next[page]] = i;
+                next[page] += 1;
+            }
+        }
+
+        for (u32 pg = FF_COVERAGE_PAGE_COUNT; pg > 0; --pg)
+            coverage_index[pg] = coverage_index[pg - 1];
+
+        coverage_index[0] = 0;
+    }
+
+    return img;
+}
+
+static const ff_image_family *_ff_image_find_family(const ff_image_header *img, const_string name, u64 h)
+{
+    if (img->family_count == 0)
+        return nullptr;
+
+    const u32 *slots = _ff_image_slots(img);
+    const ff_image_family *families = _ff_image_families(img);
+    u32 mask = img->slot_count - 1;
+
+    for (u32 slot = (u32)h & mask; slots[slot] != 0; slot = (slot + 1) & mask)
+    {
+        const ff_image_family *fam = families + (slots[slot] - 1);
+
+        if (fam->hash == h && _ff_image_const_string(img, fam->name, fam->name_size) == name)
+            return fam;
+    }
+
+    return nullptr;
+}
+
+static inline const ff_image_family *_ff_image_find_family(const ff_image_header *img, const_string name)
+{
+    return _ff_image_find_family(img, name, _ff_hash(name));
+}
+
+static bool _ff_image_find_style_id(const ff_image_header *img, const_string style, u64 h, u32 *out_id)
+{
+    const u32 *slots = _ff_image_style_slots(img);
+    const ff_image_style_name *names = _ff_image_style_names(img);
+    u32 mask = img->style_slot_count - 1;
+
+    for (u32 slot = (u32)h & mask; slots[slot] != 0; slot = (slot + 1) & mask)
+    {
+        const ff_image_style_name *sn = names + (slots[slot] - 1);
+
+        if (sn->hash == h && _ff_image_const_string(img, sn->name, sn->name_size) == style)
+        {
+            *out_id = slots[slot] - 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static inline bool _ff_image_find_style_id(const ff_image_header *img, const_string style, u32 *out_id)
+{
+    return _ff_image_find_style_id(img, style, _ff_hash(style), out_id);
+}
+
+static const ff_image_style *_ff_image_find_style(const ff_image_header *img, const ff_image_family *fam, u32 style_id)
+{
+    const ff_image_style *styles = _ff_image_styles(img) + fam->first_style;
+
+    for (u32 i = 0; i < fam->style_count; ++i)
+        if (styles[i].style_id == style_id)
+            return styles + i;
+
+    return nullptr;
+}
+
+static inline const_string _ff_image_style_name(const ff_image_header *img, u32 style_id)
+{
+    const ff_image_style_name *sn = _ff_image_style_names(img) + style_id;
+    return _ff_image_const_string(img, sn->name, sn->name_size);
+}
+
+// index of the first family whose name is not less than prefix, i.e. the first
+// family that may begin with prefix. all families beginning with prefix follow.
+static u32 _ff_image_lower_bound(const ff_image_header *img, const_string prefix)
+{
+    const ff_image_family *families = _ff_image_families(img);
+    u32 low = 0;
+    u32 high = img->family_count;
+
+    while (low < high)
+    {
+        u32 mid = low + ((high - low) >> 1);
+        const ff_image_family *fam = families + mid;
+
+        if (_ff_compare_strings(_ff_image_const_string(img, fam->name, fam->name_size), prefix) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+// the exact style if there is one, otherwise the lexicographically first
+// style beginning with prefix.
+static const ff_image_style *_ff_image_find_style_vague(const ff_image_header *img, const ff_image_family *fam, const_string prefix)
+{
+    const ff_image_style *styles = _ff_image_styles(img) + fam->first_style;
+    const ff_image_style *ret = nullptr;
+    const_string ret_name{};
+
+    for (u32 i = 0; i < fam->style_count; ++i)
+    {
+        const_string name = _ff_image_style_name(img, styles[i].style_id);
+
+        if (!string_begins_with(name, prefix))
+            continue;
+
+        if (name.size == prefix.size)
+            return styles + i;
+
+        if (ret == nullptr || _ff_compare_strings(name, ret_name) < 0)
+        {
+            ret = styles + i;
+            ret_name = name;
+        }
+    }
+
+    return ret;
+}
+
+static bool _ff_image_style_covers(const ff_image_header *img, const ff_image_style *st, u32 codepoint)
+{
+    const ff_coverage_ref *pages = _ff_image_pages(img) + st->first_page;
+    u32 page = codepoint >> 8;
+    u32 low = 0;
+    u32 high = st->page_count;
+
+    while (low < high)
+    {
+        u32 mid = (low + high) >> 1;
+
+        if (pages[mid].page < page)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    if (low >= st->page_count || pages[low].page != page)
+        return false;
+
+    return _ff_leaf_has(_ff_image_leaves(img) + pages[low].leaf, codepoint);
+}
+
+// the first style (in image order) with style id style_id that covers
+// codepoint, or the first one with any style if there is none.
+static const ff_image_style *_ff_image_find_covering(const ff_image_header *img, u32 codepoint, bool has_style_id, u32 style_id)
+{
+    u32 page = codepoint >> 8;
+
+    if (page >= FF_COVERAGE_PAGE_COUNT)
+        return nullptr;
+
+    const u32 *coverage_index = _ff_image_coverage_index(img);
+    const u32 *coverage_styles = _ff_image_coverage_styles(img);
+    const ff_image_style *styles = _ff_image_styles(img);
+    const ff_image_style *ret = nullptr;
+
+    for (u32 i = coverage_index[page]; i < coverage_index[page + 1]; ++i)
+    {
+        const ff_image_style *st = styles + coverage_styles[i];
+
+        if (ret != nullptr && (!has_style_id || st->style_id != style_id))
+            continue;
+
+        if (!_ff_image_style_covers(img, st, codepoint))
+            continue;
+
+        if (!has_style_id || st->style_id == style_id)
+            return st;
+
+        ret = st;
+    }
+
+    return ret;
+}
+
+/* The cache itself. The image is either allocated with the allocator of
+the cache, or a mapped snapshot file.
+flags are the flags the cache was loaded with, font_files is whether the
+image was built from font files instead of fontconfig caches, cache_dirs are
+the fontconfig cache directories passed to ff_load_font_cache_from_dirs
+(empty if the default ones are used). These are used by ff_cache_refresh
+and ff_cache_watch.
+*/
+struct ff_cache
+{
+    const ff_image_header *image;
+    ff_mapped_file snapshot;
+    ff_LoadFlags flags;
+    bool font_files;
+    array<string> cache_dirs;
+    ff_cache_stats stats;
+    ::allocator allocator;
+};
+
+static void init(ff_cache *cache)
+{
+    cache->image = nullptr;
+    cache->snapshot = {};
+    init(&cache->cache_dirs);
+}
+
+static void _ff_free_image(ff_cache *cache)
+{
+    if (cache->snapshot.data != nullptr)
+        _unmap_file(&cache->snapshot);
+    else if (cache->image != nullptr)
+        allocator_dealloc(cache->allocator, (void*)cache->image, cache->image->size);
+
+    cache->snapshot = {};
+    cache->image = nullptr;
+}
+
+static void free(ff_cache *cache)
+{
+    _ff_free_image(cache);
+    free<true>(&cache->cache_dirs);
+}
+
+/* SNAPSHOTS
+
+After loading the fontconfig caches, the image is written to
+$XDG_CACHE_HOME/window-base/find_font.cache (or $HOME/.cache/window-base/...).
+On the next load, the snapshot is mapped and used as-is if the fontconfig
+cache files it was built from still exist with the same sizes and
+modification times, and no cache files were added.
+The cache files still have to be listed and stat'd, but not parsed.
+*/
+#define FF_SNAPSHOT_DIR  "window-base"
+#define FF_SNAPSHOT_NAME "find_font.cache"
+
+static bool _ff_get_snapshot_dir(string *out)
+{
+    const char *xdg_cache = getenv("XDG_CACHE_HOME");
+
+    if (xdg_cache != nullptr && xdg_cache[0] != '\0')
+        string_set(out, xdg_cache);
+    else
+    {
+        const char *home = getenv("HOME");
+
+        if (home == nullptr || home[0] == '\0')
+            return false;
+
+        string_set(out, home);
+        string_append(out, "/.cache");
+    }
+
+    return true;
+}
+
+static bool _ff_get_snapshot_path(string *out)
+{
+    if (!_ff_get_snapshot_dir(out))
+        return false;
+
+    string_append(out, "/" FF_SNAPSHOT_DIR "/" FF_SNAPSHOT_NAME);
+    return true;
+}
+
+// offset and size of a nul-terminated string of the image, the terminator
+// of the last string is checked once in _ff_image_valid.
+static inline bool _ff_image_string_valid(const ff_image_header *img, u32 offset, u32 size)
+{
+    return (u64)offset + size < img->strings_size && _ff_image_string(img, offset)[size] == '\0';
+}
+
+// lookups probe until they find an empty slot
+static bool _ff_image_slots_valid(const u32 *slots, u32 slot_count, u32 max_value)
+{
+    bool has_empty = false;
+
+    for (u32 i = 0; i < slot_count; ++i)
+    {
+        if (slots[i] > max_value)
+            return false;
+
+        if (slots[i] == 0)
+            has_empty = true;
+    }
+
+    return has_empty;
+}
+
+/* A snapshot is mapped from a file anyone may have written (or truncated),
+so everything lookups follow without checking is validated once when it's
+loaded: sections within the file, table values, index ranges and string
+offsets. */
+static bool _ff_image_valid(const ff_image_header *img, s64 size)
+{
+    if (size < (s64)sizeof(ff_image_header))
+        return false;
+
+    if (img->magic != FF_IMAGE_MAGIC || img->version != FF_IMAGE_VERSION)
+        return false;
+
+    if ((s64)img->size != size)
+        return false;
+
+    if ((u64)img->families_offset + (u64)img->family_count * sizeof(ff_image_family) > img->size
+     || (u64)img->styles_offset   + (u64)img->style_count  * sizeof(ff_image_style)  > img->size
+     || (u64)img->slots_offset    + (u64)img->slot_count   * sizeof(u32)             > img->size
+     || (u64)img->style_names_offset + (u64)img->style_name_count * sizeof(ff_image_style_name) > img->size
+     || (u64)img->style_slots_offset + (u64)img->style_slot_count * sizeof(u32)               > img->size
+     || (u64)img->sources_offset  + (u64)img->source_count * sizeof(ff_image_source) > img->size
+     || (u64)img->records_offset  + (u64)img->record_count * sizeof(ff_image_record) > img->size
+     || (u64)img->leaves_offset   + (u64)img->leaf_count   * sizeof(ff_coverage_leaf) > img->size
+     || (u64)img->pages_offset    + (u64)img->page_count   * sizeof(ff_coverage_ref)  > img->size
+     || (u64)img->coverage_index_offset  + (FF_COVERAGE_PAGE_COUNT + 1) * sizeof(u32)           > img->size
+     || (u64)img->coverage_styles_offset + (u64)img->coverage_style_count * sizeof(u32)         > img->size
+     || (u64)img->strings_offset  + (u64)img->strings_size                           > img->size)
+        return false;
+
+    // slot counts must be powers of two
+    if (img->slot_count == 0 || (img->slot_count & (img->slot_count - 1)) != 0)
+        return false;
+
+    if (img->style_slot_count == 0 || (img->style_slot_count & (img->style_slot_count - 1)) != 0)
+        return false;
+
+    // every string is nul-terminated, so a string at any offset ends in the strings
+    if (img->strings_size > 0 && _ff_image_string(img, img->strings_size - 1)[0] != '\0')
+        return false;
+
+    if (!_ff_image_slots_valid(_ff_image_slots(img), img->slot_count, img->family_count)
+     || !_ff_image_slots_valid(_ff_image_style_slots(img), img->style_slot_count, img->style_name_count))
+        return false;
+
+    const ff_image_family *families = _ff_image_families(img);
+    const ff_image_style_name *style_names = _ff_image_style_names(img);
+
+    for (u32 i = 0; i < img->family_count; ++i)
+        if (!_ff_image_string_valid(img, families[i].name, families[i].name_size)
+         || (u64)families[i].first_style + families[i].style_count > img->style_count)
+            return false;
+
+    for (u32 i = 0; i < img->style_name_count; ++i)
+        if (!_ff_image_string_valid(img, style_names[i].name, style_names[i].name_size))
+            return false;
+
+    const ff_image_source *isrcs = _ff_image_sources(img);
+
+    for (u32 i = 0; i < img->source_count; ++i)
+        if ((u64)isrcs[i].first_record + isrcs[i].record_count > img->record_count
+         || !_ff_image_string_valid(img, isrcs[i].path, isrcs[i].path_size))
+            return false;
+
+    // coverage lookups index with these without checking
+    const ff_image_style *styles = _ff_image_styles(img);
+    const ff_image_record *records = _ff_image_records(img);
+    const ff_coverage_ref *pages = _ff_image_pages(img);
+    const u32 *coverage_index = _ff_image_coverage_index(img);
+    const u32 *coverage_styles = _ff_image_coverage_styles(img);
+
+    for (u32 i = 0; i < img->style_count; ++i)
+        if ((u64)styles[i].first_page + styles[i].page_count > img->page_count
+         || styles[i].style_id >= img->style_name_count
+         || styles[i].path >= img->strings_size)
+            return false;
+
+    for (u32 i = 0; i < img->record_count; ++i)
+        if ((u64)records[i].first_page + records[i].page_count > img->page_count
+         || !_ff_image_string_valid(img, records[i].name, records[i].name_size)
+         || !_ff_image_string_valid(img, records[i].style, records[i].style_size)
+         || !_ff_image_string_valid(img, records[i].path, records[i].path_size))
+            return false;
+
+    for (u32 i = 0; i < img->page_count; ++i)
+        if (pages[i].page >= FF_COVERAGE_PAGE_COUNT || pages[i].leaf >= img->leaf_count)
+            return false;
+
+    for (u32 i = 0; i < FF_COVERAGE_PAGE_COUNT; ++i)
+        if (coverage_index[i] > coverage_index[i + 1])
+            return false;
+
+    if (coverage_index[FF_COVERAGE_PAGE_COUNT] != img->coverage_style_count)
+        return false;
+
+    for (u32 i = 0; i < img->coverage_style_count; ++i)
+        if (coverage_styles[i] >= img->style_count)
+            return false;
+
+    return true;
+}
+
+static bool _ff_image_sources_match(const ff_image_header *img, array<ff_cache_source> *sources)
+{
+    if ((s64)img->source_count != sources->size)
+        return false;
+
+    const ff_image_source *isrcs = _ff_image_sources(img);
+
+    for (s64 i = 0; i < sources->size; ++i)
+    {
+        const ff_image_source *isrc = isrcs + i;
+        ff_cache_source *src = sources->data + i;
+
+        if (isrc->size != src->size
+         || isrc->mtime_sec != src->mtime_sec
+         || isrc->mtime_nsec != src->mtime_nsec)
+            return false;
+
+        if (!(_ff_image_const_string(img, isrc->path, isrc->path_size) == to_const_string(src->path)))
+            return false;
+    }
+
+    return true;
+}
+
+static bool _ff_load_snapshot(ff_cache *c, array<ff_cache_source> *sources)
+{
+    string path{};
+    path.allocator = c->allocator;
+    defer { free(&path); };
+
+    if (!_ff_get_snapshot_path(&path))
+        return false;
+
+    ff_mapped_file file{};
+
+    if (!_map_file(path.data, &file))
+        return false;
+
+    const ff_image_header *img = (const ff_image_header*)file.data;
+
+    if (!_ff_image_valid(img, file.size) || !_ff_image_sources_match(img, sources))
+    {
+        _unmap_file(&file);
+        return false;
+    }
+
+    c->snapshot = file;
+    c->image = img;
+    return true;
+}
+
+static void _ff_write_snapshot(const ff_image_header *img, ::allocator a)
+{
+    string path{};
+    path.allocator = a;
+    defer { free(&path); };
+
+    if (!_ff_get_snapshot_dir(&path))
+        return;
+
+    // failing is fine if they already exist
+    mkdir(path.data, 0755);
+    string_append(&path, "/" FF_SNAPSHOT_DIR);
+    mkdir(path.data, 0755);
+    string_append(&path, "/" FF_SNAPSHOT_NAME);
+
+    // write to a temporary file first, then rename, so other processes never
+    // map a partially written snapshot.
+    string tmp_path{};
+    tmp_path.allocator = a;
+    defer { free(&tmp_path); };
+    string_copy(to_const_string(path), &tmp_path);
+    string_append(&tmp_path, ".XXXXXX");
+
+    int fd = mkstemp(tmp_path.data);
+
+    if (fd < 0)
+        return;
+
+    fchmod(fd, 0644);
+
+    const char *data = (const char*)img;
+    s64 left = (s64)img->size;
+    bool ok = true;
+
+    while (left > 0)
+    {
+        ssize_t written = write(fd, data, (size_t)left);
+
+        if (written <= 0)
+        {
+            ok = false;
+            break;
+        }
+
+        data += written;
+        left -= written;
+    }
+
+    close(fd);
+
+    if (!ok || rename(tmp_path.data, path.data) != 0)
+        unlink(tmp_path.data);
+}
+
+// finds the fontconfig cache files, or the font files if there are none.
+// doesn't modify c, a refresh that fails keeps the cache as it was.
+static bool _find_source_files(ff_cache *c, array<ff_cache_source> *source_files, ff_parse_function *parse, bool *font_files)
+{
+    *parse = _parse_fontconfig_cache_file;
+    *font_files = false;
+
+    if (c->cache_dirs.size > 0)
+    {
+        for_array(dir, &c->cache_dirs)
+            _find_cache_files(to_const_string(*dir), source_files, c->allocator);
+
+        if (source_files->size == 0)
+        {
+            tprint("Error: no fontconfig cache files found in the given directories\n");
+            return false;
+        }
+
+        return true;
+    }
+
+    if ((c->flags & ff_LoadFlags_FontDirectories) == 0
+     && _find_fontconfig_cache_files(source_files, c->allocator))
+        return true;
+
+    *parse = _parse_font_file;
+    *font_files = true;
+
+    if (!_find_font_files(source_files, c->allocator))
+    {
+        tprint("Error: no fontconfig cache files and no font files found\n");
+        return false;
+    }
+
+    return true;
+}
+
+// sets the stats that only depend on the image.
+static void _ff_image_stats(const ff_image_header *img, ff_cache_stats *stats)
+{
+    stats->patterns = (int)img->record_count;
+    stats->families = (int)img->family_count;
+    stats->styles = (int)img->style_count;
+    stats->style_names = (int)img->style_name_count;
+    stats->image_bytes = (long long)img->size;
+}
+
+// builds a new image from source_files, previous is passed on to
+// _load_source_files.
+static const ff_image_header *_ff_build_from_sources(ff_cache *c, array<ff_cache_source> *source_files, ff_parse_function parse, ff_cache_stats *stats, const ff_image_header *previous)
+{
+    ff_cache_builder b{};
+    b.allocator = c->allocator;
+    init(&b);
+    defer { free(&b); };
+
+    if (!_load_source_files(&b, source_files, parse, stats, previous))
+        return nullptr;
+
+    timespan start;
+    get_time(&start);
+
+    const ff_image_header *img = _ff_build_image(&b, source_files, c->allocator);
+
+    stats->build_seconds = _ff_seconds_since(&start);
+    stats->bytes_allocated += _ff_builder_bytes(&b);
+
+    return img;
+}
+
+static bool _load_fonts(ff_cache *c, ff_LoadFlags flags)
+{
+    array<ff_cache_source> source_files{};
+    source_files.allocator = c->allocator;
+    defer { free<true>(&source_files); };
+
+    ff_cache_stats stats{};
+    timespan load_start;
+    timespan start;
+    get_time(&load_start);
 
-        fontconfig_elt *elts = (fontconfig_elt*)((char*)font + (font->elts_offset & ~1));
-        (void)elts;
-        
-        const_string name  = to_const_string(_fontconfig_find_pattern_string_object(font, FC_FAMILY_OBJECT));
-        const_string style = to_const_string(_fontconfig_find_pattern_string_object(font, FC_STYLE_OBJECT));
-        const_string path  = to_const_string(_fontconfig_find_pattern_string_object(font, FC_FILE_OBJECT));
+    c->flags = flags;
+    ff_parse_function parse = nullptr;
 
-        ff_cache_entry *e = search_by_hash(&c->entries, hash(name));
+    if (!_find_source_files(c, &source_files, &parse, &c->font_files))
+        return false;
 
-        if (e == nullptr)
-        {
-            string key{};
-            key.allocator = c->allocator;
-            string_copy(name, &key);
-            e = add_element_by_key(&c->entries, &key);
-            init(&e->styles);
-        }
+    stats.scan_seconds = _ff_seconds_since(&load_start);
+    stats.files_scanned = (int)source_files.size;
+    stats.font_files = c->font_files;
 
-        ff_cache_entry_style *st = _ff_find_style(e, style);
+    // the snapshot stores the source files, so a snapshot made from fontconfig
+    // caches never matches font files and vice versa.
+    if ((flags & ff_LoadFlags_NoSnapshot) == 0)
+    {
+        get_time(&start);
+        stats.from_snapshot = _ff_load_snapshot(c, &source_files);
+        stats.snapshot_seconds = _ff_seconds_since(&start);
+    }
 
-        if (st != nullptr)
-        {
-            /*
-            if (st->path != path)
-                tprint("  Warning: path mismatch in font %, style %: %, %\n", name, style, path, st->path);
-            */
-        }
-        else
+    if (!stats.from_snapshot)
+    {
+        c->image = _ff_build_from_sources(c, &source_files, parse, &stats, nullptr);
+
+        if (c->image == nullptr)
+            return false;
+
+        if ((flags & ff_LoadFlags_NoSnapshot) == 0)
         {
-            ff_cache_entry_style *newstyle = add_at_end(&e->styles);
-            newstyle->style_name = {};
-            newstyle->style_name.allocator = c->allocator;
-            string_copy(style, &newstyle->style_name);
-
-            newstyle->path = {};
-            newstyle->path.allocator = c->allocator;
-            string_copy(path, &newstyle->path);
+            get_time(&start);
+            _ff_write_snapshot(c->image, c->allocator);
+            stats.snapshot_seconds += _ff_seconds_since(&start);
         }
     }
+
+    _ff_image_stats(c->image, &stats);
+    stats.total_seconds = _ff_seconds_since(&load_start);
+    c->stats = stats;
+
+    return true;
 }
 
-static bool _load_fontconfig_cache(ff_cache *c)
+/* Refreshing
+
+The image is never modified in place (it may be a read-only mapped snapshot,
+and all lookups depend on its layout), instead a new image is built and
+replaces the old one.
+Sources that are unchanged since the current image was built are not parsed
+again, their fonts are taken from the records of the current image, see
+_ff_reuse_records. Changed and new sources are parsed, removed sources are
+dropped. The result is the same as loading the cache from scratch.
+*/
+static bool _refresh_fonts(ff_cache *c)
 {
-    array<string> cache_files{};
-    cache_files.allocator = c->allocator;
-    defer { free<true>(&cache_files); };
+    array<ff_cache_source> source_files{};
+    source_files.allocator = c->allocator;
+    defer { free<true>(&source_files); };
+
+    ff_cache_stats stats{};
+    timespan refresh_start;
+    get_time(&refresh_start);
+
+    ff_parse_function parse = nullptr;
+    bool font_files = false;
+
+    if (!_find_source_files(c, &source_files, &parse, &font_files))
+        return false;
+
+    if (_ff_image_sources_match(c->image, &source_files))
+        return false;
+
+    stats.scan_seconds = _ff_seconds_since(&refresh_start);
+    stats.files_scanned = (int)source_files.size;
+    stats.font_files = font_files;
+
+    const ff_image_header *img = _ff_build_from_sources(c, &source_files, parse, &stats, c->image);
+
+    if (img == nullptr)
+        return false;
+
+    _ff_free_image(c);
+    c->image = img;
+    c->font_files = font_files;
+
+    if ((c->flags & ff_LoadFlags_NoSnapshot) == 0)
+    {
+        timespan start;
+        get_time(&start);
+        _ff_write_snapshot(c->image, c->allocator);
+        stats.snapshot_seconds = _ff_seconds_since(&start);
+    }
+
+    _ff_image_stats(c->image, &stats);
+    stats.total_seconds = _ff_seconds_since(&refresh_start);
+    c->stats = stats;
+
+    return true;
+}
+
+/* Watching
+
+inotify watches on the directories the sources were found in (and the
+top-level font or fontconfig cache directories), ff_cache_watch_poll drains
+all pending events and refreshes once if there were any.
+Font files are found recursively, so all directories below the font
+directories are watched, including ones created later (IN_CREATE with
+IN_ISDIR): directories are watched again before every refresh, fonts
+copied into a new directory before that are found by the refresh, later
+ones cause events. Directories that don't exist are not watched.
+*/
+#define FF_WATCH_MASK (IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+
+struct ff_cache_watch
+{
+    ff_cache *cache;
+    int fd;
+};
+
+static void _ff_watch_dir(ff_cache_watch *w, const char *dir)
+{
+    // watching the same directory again just returns the existing watch
+    inotify_add_watch(w->fd, dir, FF_WATCH_MASK);
+}
+
+// like _find_font_files_in_dir
+static void _ff_watch_dir_tree(ff_cache_watch *w, const_string dir, ::allocator allocator, int depth)
+{
+    if (depth > FF_MAX_FONT_DIR_DEPTH)
+        return;
+
+    DIR *d = opendir(dir.c_str);
+
+    if (d == nullptr)
+        return;
+
+    _ff_watch_dir(w, dir.c_str);
+
+    string path{};
+    path.allocator = allocator;
+    defer { free(&path); };
 
-    string fc_path{};
-    defer { free(&fc_path); };
     struct statx st{};
-    bool any_fontconfig_path_found = false;
 
-    for_array(ppath, &_fontconfig_cache_dirs)
+    for (dirent *ent = readdir(d); ent != nullptr; ent = readdir(d))
     {
-        string_set(&fc_path, *ppath);
-        resolve_environment_variables(&fc_path, true);
-        fill_memory(fc_path.data + fc_path.size, 0, fc_path.reserved_size - fc_path.size);
+        const_string filename = to_const_string((const char*)ent->d_name);
 
-        if (statx(AT_FDCWD, fc_path.data, 0, STATX_TYPE, &st) != 0)
+        // also skips . and ..
+        if (filename.size == 0 || filename.c_str[0] == '.')
             continue;
 
-        if (!S_ISDIR(st.stx_mode))
+        string_set(&path, dir);
+        string_append(&path, "/");
+        string_append(&path, filename);
+
+        // follows symlinks
+        if (statx(AT_FDCWD, path.data, 0, STATX_TYPE, &st) != 0 || !S_ISDIR(st.stx_mode))
             continue;
 
-        any_fontconfig_path_found = true;
-        _find_cache_files(to_const_string(fc_path), &cache_files, c->allocator);
+        _ff_watch_dir_tree(w, to_const_string(path), allocator, depth + 1);
     }
 
-    if (!any_fontconfig_path_found)
+    closedir(d);
+}
+
+static void _ff_watch_dirs(ff_cache_watch *w)
+{
+    ff_cache *c = w->cache;
+    string dir{};
+    dir.allocator = c->allocator;
+    defer { free(&dir); };
+
+    if (c->cache_dirs.size > 0)
     {
-        tprint("Error: no fontconfig cache path found\n");
-        return false;
+        for_array(cdir, &c->cache_dirs)
+            _ff_watch_dir(w, cdir->data);
     }
-
-    if (cache_files.size == 0)
+    else if (c->font_files)
     {
-        tprint("Error: no fontconfig cache files found\n");
-        return false;
+        for_array(pdir, &_font_dirs)
+        {
+            string_set(&dir, *pdir);
+            resolve_environment_variables(&dir, true);
+            fill_memory(dir.data + dir.size, 0, dir.reserved_size - dir.size);
+            _ff_watch_dir_tree(w, to_const_string(dir), c->allocator, 0);
+        }
+    }
+    else
+    {
+        for_array(pdir, &_fontconfig_cache_dirs)
+        {
+            string_set(&dir, *pdir);
+            resolve_environment_variables(&dir, true);
+            fill_memory(dir.data + dir.size, 0, dir.reserved_size - dir.size);
+            _ff_watch_dir(w, dir.data);
+        }
     }
 
-    // buffer used for storing cache file contents.
-    // is reused between files.
-    string buf{};
-    buf.allocator = c->allocator;
+    // sources are grouped by directory, so only compare with the last one
+    const ff_image_header *img = c->image;
+    const ff_image_source *isrcs = _ff_image_sources(img);
+    const_string last_dir{};
 
-    for_array(file, &cache_files)
-        _parse_fontconfig_cache_file(c, *file, &buf);
+    for (u32 i = 0; i < img->source_count; ++i)
+    {
+        const_string path = _ff_image_const_string(img, isrcs[i].path, isrcs[i].path_size);
+        s64 slash = path.size - 1;
 
-    free(&buf);
-    
-    return true;
+        while (slash > 0 && path.c_str[slash] != '/')
+            slash -= 1;
+
+        if (slash <= 0)
+            continue;
+
+        const_string parent = to_const_string(path.c_str, slash);
+
+        if (parent == last_dir)
+            continue;
+
+        last_dir = parent;
+        string_set(&dir, parent);
+        _ff_watch_dir(w, dir.data);
+    }
 }
 #endif
 
-extern "C" ff_cache *ff_load_font_cache(void *_alloc)
+extern "C" ff_cache *ff_load_font_cache(void *_alloc, ff_LoadFlags flags)
 {
     ::allocator a = default_allocator;
 
@@ -678,50 +3496,315 @@ extern "C" ff_cache *ff_load_font_cache(void *_alloc)
     with_allocator(a)
     {
 #if Windows
+        (void)flags;
         init(ret);
 
+        timespan start;
+        get_time(&start);
+
         if (!_load_registry_fonts(ret))
         {
             ff_unload_font_cache(ret);
             return nullptr;
         }
+
+        _registry_stats(ret, &start);
 #elif Linux
         init(ret);
 
-        if (!_load_fontconfig_cache(ret))
+        if (!_load_fonts(ret, flags))
         {
             ff_unload_font_cache(ret);
             return nullptr;
         }
+#endif
+    }
 
-        /*
-        put("\n\n");
+    return ret;
+}
+
+extern "C" ff_cache *ff_load_font_cache_from_dirs(const char **cache_dirs, int dir_count, void *_alloc, ff_LoadFlags flags)
+{
+#if Windows
+    (void)cache_dirs;
+    (void)dir_count;
+    (void)_alloc;
+    (void)flags;
+    return nullptr;
+#elif Linux
+    if (cache_dirs == nullptr || dir_count <= 0)
+        return nullptr;
+
+    ::allocator a = default_allocator;
+
+    if (_alloc != nullptr)
+        a = *(allocator*)_alloc;
+
+    ff_cache *ret = allocator_alloc_T(a, ff_cache);
+    fill_memory(ret, 0);
+    ret->allocator = a;
+
+    with_allocator(a)
+    {
+        init(ret);
 
-        for_hash_table(font_name, entry, &ret->entries)
+        for (int i = 0; i < dir_count; ++i)
         {
-            tprint("\n%:\n", font_name);
+            string *dir = add_at_end(&ret->cache_dirs);
+            *dir = {};
+            dir->allocator = a;
+            string_set(dir, cache_dirs[i]);
+        }
 
-            for_array(st, &entry->styles)
-                tprint("  %: %\n", st->style_name, st->path);
+        // the snapshot is only for the default directories
+        if (!_load_fonts(ret, flags | ff_LoadFlags_NoSnapshot))
+        {
+            ff_unload_font_cache(ret);
+            return nullptr;
         }
+    }
 
-        put("\n\n\n");
-        */
+    return ret;
 #endif
+}
+
+extern "C" void ff_unload_font_cache(ff_cache *cache)
+{
+    if (cache == nullptr)
+        return;
+
+    allocator a = cache->allocator;
+
+    free(cache);
+    allocator_dealloc_T(a, cache, ff_cache);
+}
+
+extern "C" bool ff_cache_refresh(ff_cache *cache)
+{
+    if (cache == nullptr)
+        return false;
+
+    bool ret = false;
+
+    with_allocator(cache->allocator)
+    {
+#if Windows
+        ff_cache reloaded{};
+        reloaded.allocator = cache->allocator;
+        init(&reloaded);
+
+        timespan start;
+        get_time(&start);
+
+        if (!_load_registry_fonts(&reloaded))
+        {
+            free(&reloaded);
+            return false;
+        }
+
+        _registry_stats(&reloaded, &start);
+
+        free(cache);
+        *cache = reloaded;
+        ret = true;
+#elif Linux
+        ret = _refresh_fonts(cache);
+#endif
+    }
+
+    return ret;
+}
+
+extern "C" void ff_cache_get_stats(ff_cache *cache, ff_cache_stats *out)
+{
+    assert(cache != nullptr);
+    assert(out != nullptr);
+
+    *out = cache->stats;
+}
+
+extern "C" ff_cache_watch *ff_cache_watch_create(ff_cache *cache)
+{
+    if (cache == nullptr)
+        return nullptr;
+
+#if Windows
+    return nullptr;
+#elif Linux
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (fd < 0)
+        return nullptr;
+
+    ff_cache_watch *ret = allocator_alloc_T(cache->allocator, ff_cache_watch);
+    ret->cache = cache;
+    ret->fd = fd;
+
+    with_allocator(cache->allocator)
+        _ff_watch_dirs(ret);
+
+    return ret;
+#endif
+}
+
+extern "C" int ff_cache_watch_fd(ff_cache_watch *watch)
+{
+#if Windows
+    (void)watch;
+    return -1;
+#elif Linux
+    if (watch == nullptr)
+        return -1;
+
+    return watch->fd;
+#endif
+}
+
+extern "C" bool ff_cache_watch_poll(ff_cache_watch *watch)
+{
+#if Windows
+    (void)watch;
+    return false;
+#elif Linux
+    if (watch == nullptr)
+        return false;
+
+    // the contents of the events don't matter, just whether there were any
+    alignas(inotify_event) char buf[4096];
+    bool any_event = false;
+
+    while (read(watch->fd, buf, sizeof(buf)) > 0)
+        any_event = true;
+
+    if (!any_event)
+        return false;
+
+    // there may be new directories, watched before refreshing so nothing
+    // written to them in between is missed.
+    with_allocator(watch->cache->allocator)
+        _ff_watch_dirs(watch);
+
+    bool ret = ff_cache_refresh(watch->cache);
+
+    // and directories of new sources
+    with_allocator(watch->cache->allocator)
+        _ff_watch_dirs(watch);
+
+    return ret;
+#endif
+}
+
+extern "C" void ff_cache_watch_destroy(ff_cache_watch *watch)
+{
+#if Linux
+    if (watch == nullptr)
+        return;
+
+    close(watch->fd);
+    allocator_dealloc_T(watch->cache->allocator, watch, ff_cache_watch);
+#else
+    (void)watch;
+#endif
+}
+
+/* Asynchronous loading
+
+ff_load_font_cache runs on a thread of its own, the handle owns the thread.
+ff_cache_load_done polls (on Linux by trying to join the thread), and
+ff_cache_load_wait joins the thread and frees the handle.
+If the thread can't be created, the cache is loaded right away instead.
+*/
+struct ff_cache_load
+{
+    ::allocator allocator;
+    ff_LoadFlags flags;
+    ff_cache *cache;
+    bool joined;
+#if Windows
+    HANDLE thread;
+#elif Linux
+    pthread_t thread;
+#endif
+};
+
+#if Windows
+static DWORD WINAPI _ff_load_thread(LPVOID userdata)
+#elif Linux
+static void *_ff_load_thread(void *userdata)
+#endif
+{
+    ff_cache_load *load = (ff_cache_load*)userdata;
+    load->cache = ff_load_font_cache(&load->allocator, load->flags);
+    return 0;
+}
+
+extern "C" ff_cache_load *ff_load_font_cache_async(void *_alloc, ff_LoadFlags flags)
+{
+    ::allocator a = default_allocator;
+
+    if (_alloc != nullptr)
+        a = *(allocator*)_alloc;
+
+    ff_cache_load *ret = allocator_alloc_T(a, ff_cache_load);
+    fill_memory(ret, 0);
+    ret->allocator = a;
+    ret->flags = flags;
+
+#if Windows
+    ret->thread = CreateThread(nullptr, 0, _ff_load_thread, ret, 0, nullptr);
+    bool started = ret->thread != nullptr;
+#elif Linux
+    bool started = pthread_create(&ret->thread, nullptr, _ff_load_thread, ret) == 0;
+#endif
+
+    if (!started)
+    {
+        _ff_load_thread(ret);
+        ret->joined = true;
     }
 
     return ret;
 }
 
-extern "C" void ff_unload_font_cache(ff_cache *cache)
+extern "C" bool ff_cache_load_done(ff_cache_load *load)
+{
+    if (load == nullptr || load->joined)
+        return true;
+
+#if Windows
+    if (WaitForSingleObject(load->thread, 0) != WAIT_OBJECT_0)
+        return false;
+
+    CloseHandle(load->thread);
+#elif Linux
+    if (pthread_tryjoin_np(load->thread, nullptr) != 0)
+        return false;
+#endif
+
+    load->joined = true;
+    return true;
+}
+
+extern "C" ff_cache *ff_cache_load_wait(ff_cache_load *load)
 {
-    if (cache == nullptr)
-        return;
+    if (load == nullptr)
+        return nullptr;
 
-    allocator a = cache->allocator;
+    if (!load->joined)
+    {
+#if Windows
+        WaitForSingleObject(load->thread, INFINITE);
+        CloseHandle(load->thread);
+#elif Linux
+        pthread_join(load->thread, nullptr);
+#endif
+    }
 
-    free(cache);
-    allocator_dealloc_T(a, cache, ff_cache);
+    ff_cache *ret = load->cache;
+    ::allocator a = load->allocator;
+    allocator_dealloc_T(a, load, ff_cache_load);
+
+    return ret;
 }
 
 extern "C" const char *ff_find_font_path(ff_cache *cache, const char *font_name, const char *_style_name)
@@ -756,17 +3839,23 @@ extern "C" const char *ff_find_font_path(ff_cache *cache, const char *font_name,
     return ret->data;
 
 #elif Linux
-    ff_cache_entry *e = search_by_hash(&cache->entries, hash(font_name));
+    const ff_image_header *img = cache->image;
+    u32 style_id = 0;
 
-    if (e == nullptr)
+    if (!_ff_image_find_style_id(img, style_name, &style_id))
         return nullptr;
 
-    ff_cache_entry_style *st = _ff_find_style(e, style_name);
+    const ff_image_family *fam = _ff_image_find_family(img, to_const_string(font_name));
+
+    if (fam == nullptr)
+        return nullptr;
+
+    const ff_image_style *st = _ff_image_find_style(img, fam, style_id);
 
     if (st == nullptr)
         return nullptr;
 
-    return st->path.data;
+    return _ff_image_string(img, st->path);
 #else
     return nullptr;
 #endif
@@ -806,33 +3895,25 @@ extern "C" const char *ff_find_font_path_vague(ff_cache *cache, const char *_fon
 
     return ret->data;
 #elif Linux
-    ff_cache_entry *e = nullptr;
+    // families are sorted, so all families beginning with font_name are
+    // next to each other, and the first one with a matching style wins.
+    const ff_image_header *img = cache->image;
+    const ff_image_family *families = _ff_image_families(img);
 
-    for_array(hentry, &cache->entries.data)
+    for (u32 i = _ff_image_lower_bound(img, font_name); i < img->family_count; ++i)
     {
-        if (hentry->hash <= FIRST_HASH)
-            continue;
+        const ff_image_family *fam = families + i;
 
-        if (string_begins_with(hentry->key, font_name))
-        {
-            e = &hentry->value;
+        if (!string_begins_with(_ff_image_const_string(img, fam->name, fam->name_size), font_name))
             break;
-        }
-    }
-
-    if (e == nullptr)
-        return nullptr;
 
-    ff_cache_entry_style *st = nullptr;
+        const ff_image_style *st = _ff_image_find_style_vague(img, fam, style_name);
 
-    for_array(_st, &e->styles)
-        if (string_begins_with(_st->style_name, style_name))
-            st = _st;
-
-    if (st == nullptr)
-        return nullptr;
+        if (st != nullptr)
+            return _ff_image_string(img, st->path);
+    }
 
-    return st->path.data;
+    return nullptr;
 #else
     return nullptr;
 #endif
@@ -868,25 +3949,94 @@ extern "C" const char *ff_find_first_font_path(ff_cache *cache, const char **fon
 
     return ret;
 #elif Linux
-    const_string style_name{};
-    ff_cache_entry *e = nullptr;
-    ff_cache_entry_style *st = nullptr;
+    if (cache == nullptr)
+        return nullptr;
+
+    const ff_image_header *img = cache->image;
+    const ff_image_family *fam = nullptr;
+    const ff_image_style *st = nullptr;
+    u32 style_id = 0;
 
     for (int i = 0; i < count; i += 2)
     {
         const char *_font_name  = font_names_and_styles[i];
         const char *_style_name = font_names_and_styles[i + 1];
 
+        if (_font_name == nullptr)
+            continue;
+
         if (_style_name == nullptr || string_length(_style_name) == 0)
             _style_name = FF_DEFAULT_STYLE;
 
-        e = search_by_hash(&cache->entries, hash(_font_name));
+        if (!_ff_image_find_style_id(img, to_const_string(_style_name), &style_id))
+            continue;
+
+        fam = _ff_image_find_family(img, to_const_string(_font_name));
+
+        if (fam == nullptr)
+            continue;
+
+        st = _ff_image_find_style(img, fam, style_id);
+
+        if (st == nullptr)
+            continue;
+
+        if (found_index != nullptr)
+            *found_index = i;
+
+        return _ff_image_string(img, st->path);
+    }
+
+    return nullptr;
+#else
+    return nullptr;
+#endif
+}
+
+extern "C" const char *ff_find_first_font_path_precomputed(ff_cache *cache, const ff_query *queries, int count, int *found_index)
+{
+    if (cache == nullptr || queries == nullptr || count <= 0)
+        return nullptr;
+
+#if Windows
+    for (int i = 0; i < count; ++i)
+    {
+        const char *ret = ff_find_font_path(cache, queries[i].font_name, queries[i].style_name);
+
+        if (ret != nullptr)
+        {
+            if (found_index != nullptr)
+                *found_index = i;
+
+            return ret;
+        }
+    }
+
+    return nullptr;
+#elif Linux
+    static constexpr ff_query default_style = ff_make_query("", FF_DEFAULT_STYLE);
+
+    const ff_image_header *img = cache->image;
+
+    for (int i = 0; i < count; ++i)
+    {
+        const ff_query *q = queries + i;
+
+        if (q->font_name == nullptr)
+            continue;
+
+        const ff_query *sq = q->style_name_size > 0 ? q : &default_style;
+        u32 style_id = 0;
+
+        if (!_ff_image_find_style_id(img, to_const_string(sq->style_name, sq->style_name_size), sq->style_hash, &style_id))
+            continue;
+
+        const ff_image_family *fam = _ff_image_find_family(img, to_const_string(q->font_name, q->font_name_size), q->font_hash);
 
-        if (e == nullptr)
+        if (fam == nullptr)
             continue;
 
-        style_name = to_const_string(_style_name);
-        st = _ff_find_style(e, style_name);
+        const ff_image_style *st = _ff_image_find_style(img, fam, style_id);
 
         if (st == nullptr)
             continue;
@@ -894,10 +4044,144 @@ extern "C" const char *ff_find_first_font_path(ff_cache *cache, const char **fon
         if (found_index != nullptr)
             *found_index = i;
 
-        return st->path.data;
+        return _ff_image_string(img, st->path);
+    }
+
+    return nullptr;
+#else
+    return nullptr;
+#endif
+}
+
+#if Linux
+// batch queries are sorted by the hash slot of their family, so the slots
+// (and mostly the families too, as long as the table isn't too crowded)
+// are visited front to back instead of in random order.
+struct ff_batch_query
+{
+    u64 hash;
+    u32 slot;
+    int index;
+};
+
+static int _compare_batch_queries(const ff_batch_query *lhs, const ff_batch_query *rhs)
+{
+    if (lhs->slot < rhs->slot) return -1;
+    if (lhs->slot > rhs->slot) return  1;
+    if (lhs->index < rhs->index) return -1;
+    if (lhs->index > rhs->index) return  1;
+
+    return 0;
+}
+#endif
+
+extern "C" int ff_find_font_paths_batch(ff_cache *cache, const char **font_names_and_styles, int count, const char **out_paths)
+{
+    if (cache == nullptr || font_names_and_styles == nullptr || out_paths == nullptr)
+        return 0;
+
+    // count must be even
+    if (count <= 0 || ((count & 1) != 0))
+        return 0;
+
+    int pair_count = count / 2;
+    int found = 0;
+
+#if Windows
+    for (int i = 0; i < pair_count; ++i)
+    {
+        out_paths[i] = ff_find_font_path(cache, font_names_and_styles[i * 2], font_names_and_styles[i * 2 + 1]);
+
+        if (out_paths[i] != nullptr)
+            found += 1;
+    }
+#elif Linux
+    const ff_image_header *img = cache->image;
+    u32 mask = img->slot_count - 1;
+
+    ff_batch_query *queries = (ff_batch_query*)allocator_alloc(cache->allocator, sizeof(ff_batch_query) * pair_count);
+    defer { allocator_dealloc(cache->allocator, queries, sizeof(ff_batch_query) * pair_count); };
+
+    // hash everything up front
+    int query_count = 0;
+
+    for (int i = 0; i < pair_count; ++i)
+    {
+        out_paths[i] = nullptr;
+
+        const char *_font_name = font_names_and_styles[i * 2];
+
+        if (_font_name == nullptr)
+            continue;
+
+        ff_batch_query *q = queries + query_count;
+        q->hash = _ff_hash(to_const_string(_font_name));
+        q->slot = (u32)q->hash & mask;
+        q->index = i;
+        query_count += 1;
+    }
+
+    if (query_count > 1)
+        sort(queries, query_count, _compare_batch_queries);
+
+    for (int i = 0; i < query_count; ++i)
+    {
+        ff_batch_query *q = queries + i;
+        const char *_font_name  = font_names_and_styles[q->index * 2];
+        const char *_style_name = font_names_and_styles[q->index * 2 + 1];
+
+        if (_style_name == nullptr || string_length(_style_name) == 0)
+            _style_name = FF_DEFAULT_STYLE;
+
+        u32 style_id = 0;
+
+        if (!_ff_image_find_style_id(img, to_const_string(_style_name), &style_id))
+            continue;
+
+        const ff_image_family *fam = _ff_image_find_family(img, to_const_string(_font_name), q->hash);
+
+        if (fam == nullptr)
+            continue;
+
+        const ff_image_style *st = _ff_image_find_style(img, fam, style_id);
+
+        if (st == nullptr)
+            continue;
+
+        out_paths[q->index] = _ff_image_string(img, st->path);
+        found += 1;
     }
+#else
+    for (int i = 0; i < pair_count; ++i)
+        out_paths[i] = nullptr;
+#endif
+
+    return found;
+}
+
+extern "C" const char *ff_find_font_covering(ff_cache *cache, u32 codepoint, const char *_preferred_style)
+{
+    if (cache == nullptr)
+        return nullptr;
 
+#if Windows
+    (void)codepoint;
+    (void)_preferred_style;
     return nullptr;
+#elif Linux
+    if (_preferred_style == nullptr || string_length(_preferred_style) == 0)
+        _preferred_style = FF_DEFAULT_STYLE;
+
+    const ff_image_header *img = cache->image;
+    u32 style_id = 0;
+    bool has_style_id = _ff_image_find_style_id(img, to_const_string(_preferred_style), &style_id);
+
+    const ff_image_style *st = _ff_image_find_covering(img, codepoint, has_style_id, style_id);
+
+    if (st == nullptr)
+        return nullptr;
+
+    return _ff_image_string(img, st->path);
 #else
     return nullptr;
 #endif
@@ -924,7 +4208,9 @@ extern "C" const char *ff_find_first_font_path_vague(ff_cache *cache, const char
 
         if (ret != nullptr)
         {
-            *found_index = i;
+            if (found_index != nullptr)
+                *found_index = i;
+
             break;
         }
     }
@@ -945,7 +4231,9 @@ extern "C" const char *ff_find_first_font_path_vague(ff_cache *cache, const char
 
         if (ret != nullptr)
         {
-            *found_index = i;
+            if (found_index != nullptr)
+                *found_index = i;
+
             break;
         }
     }
@@ -1003,7 +4291,7 @@ bool ff_cache_iterator_next(ff_cache_iterator *it, const char **font, const char
 struct ff_cache_iterator
 {
     ff_cache *cache;
-    s64 entry_index;
+    s64 family_index;
     s64 style_index;
 };
 
@@ -1014,53 +4302,33 @@ bool ff_cache_iterator_next(ff_cache_iterator *it, const char **font, const char
     assert(style != nullptr);
     assert(path != nullptr);
 
-    if (it->entry_index >= it->cache->entries.data.size)
-    {
-        *font = nullptr;
-        *style = nullptr;
-        *path = nullptr;
-        return false;
-    }
-
-    bool new_entry = false;
-new_entry_label:
+    const ff_image_header *img = it->cache->image;
+    const ff_image_family *families = _ff_image_families(img);
 
-    while (it->entry_index < it->cache->entries.data.size && it->cache->entries.data.data[it->entry_index].hash < FIRST_HASH)
+    while (it->family_index < (s64)img->family_count)
     {
-        it->entry_index += 1;
-        it->style_index = 0;
-        new_entry = true;
-    }
+        const ff_image_family *fam = families + it->family_index;
 
-    if (it->entry_index >= it->cache->entries.data.size)
-    {
-        *font = nullptr;
-        *style = nullptr;
-        *path = nullptr;
-        return false;
-    }
+        if (it->style_index < (s64)fam->style_count)
+        {
+            const ff_image_style *st = _ff_image_styles(img) + fam->first_style + it->style_index;
 
-    auto *hash_entry = it->cache->entries.data.data + it->entry_index;
-    ff_cache_entry *entry = &hash_entry->value;
+            *font = _ff_image_string(img, fam->name);
+            *style = _ff_image_style_name(img, st->style_id).c_str;
+            *path = _ff_image_string(img, st->path);
 
-    if (!new_entry)
-    {
-        it->style_index += 1;
-        if (it->style_index >= entry->styles.size)
-        {
-            it->entry_index += 1;
-            it->style_index = 0;
-            new_entry = true;
-            goto new_entry_label;
+            it->style_index += 1;
+            return true;
         }
-    }
 
-    ff_cache_entry_style *style_entry = entry->styles.data + it->style_index;
+        it->family_index += 1;
+        it->style_index = 0;
+    }
 
-    *font = hash_entry->key.data;
-    *style = style_entry->style_name.data;
-    *path = style_entry->path.data;
-    return true;
+    *font = nullptr;
+    *style = nullptr;
+    *path = nullptr;
+    return false;
 }
 #endif
 
@@ -1074,7 +4342,7 @@ ff_cache_iterator *ff_cache_iterator_create(ff_cache *cache)
 #if Windows
     it->entry_index = 0;
 #elif Linux
-    it->entry_index = 0;
+    it->family_index = 0;
     it->style_index = 0;
 #endif
 
@@ -1085,3 +4353,135 @@ void ff_cache_iterator_destroy(ff_cache_iterator *it)
 {
     allocator_dealloc_T(it->cache->allocator, it, ff_cache_iterator);
 }
+
+extern "C" int ff_cache_font_count(ff_cache *cache, int *family_count)
+{
+    assert(cache != nullptr);
+
+#if Windows
+    int count = 0;
+
+    for_array(hentry, &cache->entries.data)
+        if (hentry->hash >= FIRST_HASH)
+            count += 1;
+
+    if (family_count != nullptr)
+        *family_count = count;
+
+    return count;
+#elif Linux
+    if (family_count != nullptr)
+        *family_count = (int)cache->image->family_count;
+
+    return (int)cache->image->style_count;
+#endif
+}
+
+extern "C" int ff_cache_export(ff_cache *cache, const char **fonts, const char **styles, const char **paths, int capacity)
+{
+    assert(cache != nullptr);
+
+    int count = 0;
+
+#if Windows
+    for_array(hentry, &cache->entries.data)
+    {
+        if (count >= capacity)
+            break;
+
+        if (hentry->hash < FIRST_HASH)
+            continue;
+
+        if (fonts  != nullptr) fonts[count]  = hentry->key.data;
+        if (styles != nullptr) styles[count] = nullptr;
+        if (paths  != nullptr) paths[count]  = hentry->value.data;
+        count += 1;
+    }
+#elif Linux
+    // styles of a family are contiguous and families are in style order,
+    // so this is one pass over both arrays.
+    const ff_image_header *img = cache->image;
+    const ff_image_family *families = _ff_image_families(img);
+    const ff_image_style *all_styles = _ff_image_styles(img);
+
+    for (u32 f = 0; f < img->family_count && count < capacity; ++f)
+    {
+        const ff_image_family *fam = families + f;
+        const char *font = _ff_image_string(img, fam->name);
+        const ff_image_style *st = all_styles + fam->first_style;
+        int n = (int)fam->style_count;
+
+        if (n > capacity - count)
+            n = capacity - count;
+
+        for (int i = 0; i < n; ++i)
+        {
+            if (fonts  != nullptr) fonts[count + i]  = font;
+            if (styles != nullptr) styles[count + i] = _ff_image_style_name(img, st[i].style_id).c_str;
+            if (paths  != nullptr) paths[count + i]  = _ff_image_string(img, st[i].path);
+        }
+
+        count += n;
+    }
+#endif
+
+    return count;
+}
+
+extern "C" int ff_cache_visit_families(ff_cache *cache, ff_family_visitor visitor, void *userdata)
+{
+    assert(cache != nullptr);
+    assert(visitor != nullptr);
+
+    int count = 0;
+
+#if Windows
+    for_array(hentry, &cache->entries.data)
+    {
+        if (hentry->hash < FIRST_HASH)
+            continue;
+
+        const char *style = nullptr;
+        const char *path = hentry->value.data;
+        visitor(hentry->key.data, &style, &path, 1, userdata);
+        count += 1;
+    }
+#elif Linux
+    const ff_image_header *img = cache->image;
+    const ff_image_family *families = _ff_image_families(img);
+    const ff_image_style *all_styles = _ff_image_styles(img);
+
+    if (img->family_count == 0)
+        return 0;
+
+    u32 max_styles = 0;
+
+    for (u32 f = 0; f < img->family_count; ++f)
+        if (families[f].style_count > max_styles)
+            max_styles = families[f].style_count;
+
+    // one buffer for the styles and paths of the largest family
+    const char **buf = (const char**)allocator_alloc(cache->allocator, sizeof(const char*) * max_styles * 2);
+    defer { allocator_dealloc(cache->allocator, buf, sizeof(const char*) * max_styles * 2); };
+
+    const char **styles = buf;
+    const char **paths = buf + max_styles;
+
+    for (u32 f = 0; f < img->family_count; ++f)
+    {
+        const ff_image_family *fam = families + f;
+        const ff_image_style *st = all_styles + fam->first_style;
+
+        for (u32 i = 0; i < fam->style_count; ++i)
+        {
+            styles[i] = _ff_image_style_name(img, st[i].style_id).c_str;
+            paths[i]  = _ff_image_string(img, st[i].path);
+        }
+
+        visitor(_ff_image_string(img, fam->name), styles, paths, (int)fam->style_count, userdata);
+        count += 1;
+    }
+#endif
+
+    return count;
+}
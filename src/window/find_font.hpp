@@ -7,20 +7,106 @@ extern "C"
 {
 struct ff_cache;
 
+// naming convention same as ImGui
+enum ff_LoadFlags_
+{
+    ff_LoadFlags_None       = 0,
+    ff_LoadFlags_NoSnapshot = 1 << 0, // Linux: don't use or write the snapshot in $XDG_CACHE_HOME/window-base
+    ff_LoadFlags_FontDirectories = 1 << 1  // Linux: don't use fontconfig caches, read the fonts in the standard font
+                                           // directories directly. done anyway if there are no fontconfig caches.
+};
+
+typedef int ff_LoadFlags;
+
 // See shl/allocator.hpp for how an allocator looks like.
 // If allocator is nullptr, uses a default allocator.
-ff_cache *ff_load_font_cache(void *allocator = nullptr);
+// On Linux, cache files are parsed on a few worker threads which allocate
+// with the given allocator, so it must be thread-safe (the default one is).
+// After parsing, a snapshot of the cache is written which is mapped on the
+// next load if the fontconfig caches haven't changed since.
+ff_cache *ff_load_font_cache(void *allocator = nullptr, ff_LoadFlags flags = ff_LoadFlags_None);
 void      ff_unload_font_cache(ff_cache *cache);
 
+// Linux only, returns nullptr on Windows.
+// Loads only the fontconfig cache files in the given directories instead of
+// the default ones, e.g. for benchmarks. Never uses or writes a snapshot.
+ff_cache *ff_load_font_cache_from_dirs(const char **cache_dirs, int dir_count, void *allocator = nullptr, ff_LoadFlags flags = ff_LoadFlags_None);
+
+// Loads the cache on a background thread, same arguments as ff_load_font_cache.
+// ff_cache_load_done doesn't block and returns true once loading finished.
+// ff_cache_load_wait blocks until loading finished, then returns the cache
+// (nullptr if loading failed) and frees the handle, so it must be called
+// exactly once for every handle, even if the cache is not needed anymore.
+struct ff_cache_load;
+ff_cache_load *ff_load_font_cache_async(void *allocator = nullptr, ff_LoadFlags flags = ff_LoadFlags_None);
+bool           ff_cache_load_done(ff_cache_load *load);
+ff_cache      *ff_cache_load_wait(ff_cache_load *load);
+
+// Picks up fonts that were installed, changed or removed since the cache was
+// loaded. On Linux, only the fontconfig cache files (or font files) that were
+// added or changed are parsed again.
+// Returns true if the cache changed, false if nothing changed or on error, in
+// which case the cache is left as it was.
+// If the cache changed, all names and paths previously returned by the cache
+// are invalid, and iterators must not be used across a refresh.
+// On Windows, reads the Registry again and returns true.
+bool ff_cache_refresh(ff_cache *cache);
+
+// Watches the directories the cache was loaded from (inotify on Linux) so
+// ff_cache_watch_poll can refresh the cache when something changes.
+// Returns nullptr on Windows or if watching failed.
+// The watch must be destroyed before the cache is unloaded.
+struct ff_cache_watch;
+ff_cache_watch *ff_cache_watch_create(ff_cache *cache);
+// A file descriptor that becomes readable when something changed, e.g. to
+// add to a poll set. -1 on Windows.
+int             ff_cache_watch_fd(ff_cache_watch *watch);
+// Doesn't block. If something changed since the last poll, refreshes the cache
+// and returns the result of ff_cache_refresh, otherwise returns false.
+bool            ff_cache_watch_poll(ff_cache_watch *watch);
+void            ff_cache_watch_destroy(ff_cache_watch *watch);
+
+// Statistics of the load, or of the last refresh that changed the cache, e.g.
+// to find out why loading is slow on some machine.
+// On Windows, only the font counts and total_seconds are set.
+struct ff_cache_stats
+{
+    int files_scanned;          // fontconfig cache files (or font files) found
+    int files_parsed;           // not taken from the snapshot or reused by a refresh
+    int files_skipped;          // other fontconfig cache version or invalid magic number
+    int files_failed;           // could not be read or invalid
+    int patterns;               // fonts in all files, including shadowed ones
+    int families;
+    int styles;                 // (family, style) pairs
+    int style_names;            // distinct style names
+    long long bytes_read;       // size of all parsed files
+    long long bytes_allocated;  // while building, all freed after loading except the image
+    long long image_bytes;      // memory used by lookups (mapped if from_snapshot)
+    bool from_snapshot;
+    bool font_files;            // read the font files, no fontconfig caches
+    // wall time of each stage. parse includes reading, files are mapped.
+    double scan_seconds;
+    double parse_seconds;
+    double insert_seconds;
+    double build_seconds;
+    double snapshot_seconds;    // loading or writing the snapshot
+    double total_seconds;
+};
+
+void ff_cache_get_stats(ff_cache *cache, ff_cache_stats *out);
+
 // Tries to find a font by name and style, and returns the path to the font file.
 // font_name and style_name must be _exact_.
 // style_name may be nullptr or an empty string for the default style.
 const char *ff_find_font_path(ff_cache *cache, const char *font_name, const char *style_name);
 
-// Much slower, but easier to use.
+// Slower, but easier to use.
 // Names are checked using "begins_with", i.e. only start must match.
-// NOTE: if there's multiple matches, it is not guaranteed which font path is
-// returned. Use ff_find_font_path instead if you need an exact match.
+// On Linux, if there's multiple matches, the (bytewise) first family name
+// that has a matching style is used, and within that family the exact style,
+// or otherwise the first style name beginning with style_name.
+// On Windows, it is not guaranteed which font path is returned.
+// Use ff_find_font_path instead if you need an exact match.
 const char *ff_find_font_path_vague(ff_cache *cache, const char *font_name, const char *style_name);
 
 
@@ -39,6 +125,40 @@ const char *ff_find_first_font_path(ff_cache *cache, const char **font_names_and
 
 // names don't have to be exact here
 const char *ff_find_first_font_path_vague(ff_cache *cache, const char **font_names_and_styles, int count, int *found_index);
+
+// Resolves all pairs of font_names_and_styles (same form as above) at once,
+// names and styles must be exact.
+// out_paths must have room for count / 2 paths, out_paths[i] is set to the
+// path of the i-th pair, or nullptr if that font was not found.
+// Returns the number of pairs that were found.
+int ff_find_font_paths_batch(ff_cache *cache, const char **font_names_and_styles, int count, const char **out_paths);
+
+// Returns the path of a font that has a glyph for codepoint, preferring fonts
+// with style preferred_style (nullptr or empty for the default style), or
+// nullptr if no font has the codepoint.
+// If there are multiple, the (bytewise) first family is used.
+// Only on Linux, coverage comes from the fontconfig caches (or from the fonts
+// themselves, see ff_LoadFlags_FontDirectories). Always nullptr on Windows.
+const char *ff_find_font_covering(ff_cache *cache, unsigned int codepoint, const char *preferred_style);
+
+// Bulk access to all fonts in the cache, faster than iterating when listing
+// every font, e.g. in a font picker.
+// Returns the number of (font, style, path) entries in the cache, and the
+// number of families in family_count if it's not nullptr.
+int ff_cache_font_count(ff_cache *cache, int *family_count);
+
+// Writes up to capacity entries into the caller's arrays, in the same order as
+// the iterator, i.e. grouped by family. fonts[i], styles[i] and paths[i] belong
+// to the i-th entry. Any of the arrays may be nullptr if not needed.
+// Returns the number of entries written.
+// On Windows, styles are always nullptr since fonts are stored by full name.
+int ff_cache_export(ff_cache *cache, const char **fonts, const char **styles, const char **paths, int capacity);
+
+// Calls visitor once per family with all of its styles and their paths.
+// styles and paths are only valid during the call.
+// Returns the number of families visited.
+typedef void (*ff_family_visitor)(const char *font, const char **styles, const char **paths, int style_count, void *userdata);
+int ff_cache_visit_families(ff_cache *cache, ff_family_visitor visitor, void *userdata);
 }
 
 #include "shl/defer.hpp"
@@ -57,3 +177,109 @@ void ff_cache_iterator_destroy(ff_cache_iterator *it);
     if constexpr (const char *Path_Var; true)\
     if (ff_cache_iterator_next(Font_Var##_it, &Font_Var, &Style_Var, &Path_Var))\
     for (; Font_Var != nullptr; ff_cache_iterator_next(Font_Var##_it, &Font_Var, &Style_Var, &Path_Var))
+
+/* Precomputed queries
+
+An ff_query is a font name and a style name together with their sizes and
+hashes (the same hash the cache uses), computed at compile time when the
+query is constexpr, e.g.:
+
+    constexpr ff_query my_fonts[] = {
+        ff_make_query("Iosevka", "Bold"),
+        ff_make_query("Hack"),
+    };
+
+    const char *path = ff_find_first_font_path_precomputed(cache, my_fonts);
+
+ff_find_first_font_path_precomputed then doesn't measure or hash anything, it
+only probes the tables of the cache, on Linux. On Windows it is the same as
+ff_find_first_font_path.
+ff_make_queries makes the queries of an array of font and style name pairs
+(the form ff_find_first_font_path takes), find_font_fonts.hpp has those for
+the default UI and monospace fonts.
+*/
+struct ff_query
+{
+    const char *font_name;
+    const char *style_name;      // nullptr for the default style
+    unsigned int font_name_size;
+    unsigned int style_name_size;
+    unsigned long long font_hash;
+    unsigned long long style_hash;
+};
+
+// FNV-1a
+constexpr unsigned long long ff_hash(const char *str, unsigned long long size)
+{
+    unsigned long long h = 0xcbf29ce484222325ull;
+
+    for (unsigned long long i = 0; i < size; ++i)
+    {
+        h ^= (unsigned char)str[i];
+        h *= 0x100000001b3ull;
+    }
+
+    return h;
+}
+
+constexpr unsigned int ff_string_length(const char *str)
+{
+    unsigned int ret = 0;
+
+    while (str[ret] != '\0')
+        ret += 1;
+
+    return ret;
+}
+
+constexpr ff_query ff_make_query(const char *font_name, const char *style_name = nullptr)
+{
+    ff_query ret{};
+    ret.font_name = font_name;
+    ret.font_name_size = ff_string_length(font_name);
+    ret.font_hash = ff_hash(font_name, ret.font_name_size);
+
+    if (style_name != nullptr && style_name[0] != '\0')
+    {
+        ret.style_name = style_name;
+        ret.style_name_size = ff_string_length(style_name);
+        ret.style_hash = ff_hash(style_name, ret.style_name_size);
+    }
+
+    return ret;
+}
+
+template<int N>
+struct ff_queries
+{
+    ff_query queries[N];
+};
+
+template<int N>
+constexpr ff_queries<N / 2> ff_make_queries(const char *const (&font_names_and_styles)[N])
+{
+    static_assert(N % 2 == 0, "font_names_and_styles must be pairs of font and style names");
+
+    ff_queries<N / 2> ret{};
+
+    for (int i = 0; i < N / 2; ++i)
+        ret.queries[i] = ff_make_query(font_names_and_styles[i * 2], font_names_and_styles[i * 2 + 1]);
+
+    return ret;
+}
+
+// Same as ff_find_first_font_path, but with precomputed queries. count is the
+// number of queries, found_index is set to the index of the found query.
+extern "C" const char *ff_find_first_font_path_precomputed(ff_cache *cache, const ff_query *queries, int count, int *found_index);
+
+template<int N>
+inline const char *ff_find_first_font_path_precomputed(ff_cache *cache, const ff_query (&queries)[N], int *found_index = nullptr)
+{
+    return ff_find_first_font_path_precomputed(cache, queries, N, found_index);
+}
+
+template<int N>
+inline const char *ff_find_first_font_path_precomputed(ff_cache *cache, const ff_queries<N> &queries, int *found_index = nullptr)
+{
+    return ff_find_first_font_path_precomputed(cache, queries.queries, N, found_index);
+}
@@ -1,6 +1,8 @@
 
 #pragma once
 
+#include "window/find_font.hpp"
+
 constexpr int font_names_ui_count = 5;
 constexpr const char *font_names_ui[font_names_ui_count * 2] = {
     "Segoe UI",     nullptr,
@@ -20,3 +22,7 @@ constexpr const char *font_names_monospace[font_names_monospace_count * 2] = {
     "Courier New",  nullptr,
     "monospace",    nullptr
 };
+
+// same fonts as above, for ff_find_first_font_path_precomputed
+constexpr ff_queries<font_names_ui_count> font_queries_ui = ff_make_queries(font_names_ui);
+constexpr ff_queries<font_names_monospace_count> font_queries_monospace = ff_make_queries(font_names_monospace);
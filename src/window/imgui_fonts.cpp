@@ -0,0 +1,2316 @@
+#include "imgui.h"
+#include "imgui_internal.h" // ImFormatString, ImFontAtlasBuild*
+#include "shl/array.hpp"
+#include "shl/string.hpp"
+#include "shl/platform.hpp"
+#include "shl/defer.hpp"
+#include "shl/memory.hpp"
+#include "shl/sort.hpp"
+
+#include "window/imgui_fonts.hpp"
+#include "window/find_font.hpp"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#if Windows
+#include <windows.h>
+#elif Linux
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <pthread.h>
+#endif
+
+#include "GLFW/glfw3.h"
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#if defined(__clang__)
+#pragma GCC diagnostic ignored "-Wunknown-warning-option"
+#else
+#pragma GCC diagnostic ignored "-Wpragmas"
+#endif
+#pragma GCC diagnostic ignored "-Wunused-function"
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wsign-compare"
+#pragma GCC diagnostic ignored "-Wtype-limits"
+#pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
+#pragma GCC diagnostic ignored "-Wconversion"
+#pragma GCC diagnostic ignored "-Wcast-qual"
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+#elif defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable: 4244 4456 4457 4505)
+#endif
+
+// imgui_draw.cpp compiles its copies of stb_rect_pack and stb_truetype as
+// static, so they're not visible here. stb_rect_pack comes first so
+// stb_truetype packs with it, like in imgui_draw.cpp.
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "imstb_rectpack.h"
+#define STBTT_STATIC
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "imstb_truetype.h"
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#elif defined(_MSC_VER)
+#pragma warning(pop)
+#endif
+
+/* Mapped font files
+
+Font files are mapped read-only and stay mapped until imgui_fonts_exit,
+since the atlas reads the data every time it's built, not just once.
+stb_truetype only ever reads the font data, so the const cast for
+AddFontFromMemoryTTF is fine.
+AddFont copies font data the atlas doesn't own, so fonts are added as owned,
+which keeps the pointer, and ownership is taken back from the stored config
+right after, so the atlas never frees the mapping.
+There's only a handful of font files, so they're searched linearly.
+*/
+struct imgui_font_file
+{
+    string path;
+    const char *data;
+    s64 size;
+    s64 mtime; // only compared, see Atlas cache
+#if Windows
+    HANDLE mapping;
+#endif
+};
+
+static array<imgui_font_file> _font_files{};
+
+static bool _map_font_file(const char *path, imgui_font_file *out)
+{
+#if Windows
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+
+    FILETIME mtime;
+
+    if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0
+     || !GetFileTime(file, nullptr, nullptr, &mtime))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    // the mapping keeps the file open
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+
+    if (mapping == nullptr)
+        return false;
+
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (data == nullptr)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    out->data = (const char*)data;
+    out->size = (s64)size.QuadPart;
+    out->mtime = (s64)(((u64)mtime.dwHighDateTime << 32) | mtime.dwLowDateTime);
+    out->mapping = mapping;
+    return true;
+#elif Linux
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+        return false;
+
+    out->data = (const char*)data;
+    out->size = (s64)st.st_size;
+    out->mtime = (s64)st.st_mtim.tv_sec * 1000000000 + (s64)st.st_mtim.tv_nsec;
+    return true;
+#endif
+}
+
+static void _unmap_font_file(imgui_font_file *file)
+{
+    if (file->data != nullptr)
+    {
+#if Windows
+        UnmapViewOfFile(file->data);
+        CloseHandle(file->mapping);
+#elif Linux
+        munmap((void*)file->data, (size_t)file->size);
+#endif
+    }
+
+    free(&file->path);
+    file->data = nullptr;
+    file->size = 0;
+}
+
+static imgui_font_file *_get_font_file(const char *path)
+{
+    const_string p = to_const_string(path);
+
+    for_array(file, &_font_files)
+        if (to_const_string(file->path) == p)
+            return file;
+
+    imgui_font_file mapped{};
+
+    if (!_map_font_file(path, &mapped))
+        return nullptr;
+
+    string_set(&mapped.path, p);
+
+    imgui_font_file *ret = add_at_end(&_font_files);
+    *ret = mapped;
+    return ret;
+}
+
+ImFont *imgui_add_font_from_file(const char *path, float size_pixels, const ImFontConfig *config, const ImWchar *glyph_ranges)
+{
+    if (path == nullptr)
+        return nullptr;
+
+    imgui_font_file *file = _get_font_file(path);
+
+    if (file == nullptr)
+        return nullptr;
+
+    ImFontConfig cfg = config != nullptr ? *config : ImFontConfig();
+    cfg.FontDataOwnedByAtlas = true; // not copied, see Mapped font files
+
+    // same default name as AddFontFromFileTTF
+    if (cfg.Name[0] == '\0')
+    {
+        const char *name = path;
+
+        for (const char *c = path; *c != '\0'; ++c)
+            if (*c == '/' || *c == '\\')
+                name = c + 1;
+
+        ImFormatString(cfg.Name, IM_ARRAYSIZE(cfg.Name), "%s, %.0fpx", name, size_pixels);
+    }
+
+    ImFontAtlas *atlas = ImGui::GetIO().Fonts;
+    ImFont *ret = atlas->AddFontFromMemoryTTF((void*)file->data, (int)file->size, size_pixels, &cfg, glyph_ranges);
+
+    ImFontConfig *added = &atlas->ConfigData.back();
+    assert(added->FontData == file->data);
+    added->FontDataOwnedByAtlas = false;
+
+    return ret;
+}
+
+/* SDF fonts
+
+The glyphs of SDF fonts are stored in the atlas as signed distance fields
+instead of coverage: IMGUI_SDF_PADDING pixels around each glyph, the outline
+is at IMGUI_SDF_ON_EDGE and the value falls by IMGUI_SDF_ON_EDGE /
+IMGUI_SDF_PADDING per pixel away from it. The SDF shader turns the distance
+into coverage at any scale, see SDF shader.
+A font is an SDF font as a whole, every config of it (including merged ones)
+is rasterized as SDF, without oversampling.
+
+The atlas texture is shared by all fonts, so the texels of SDF glyphs are
+marked in the RGBA texture with black instead of white after building.
+*/
+#define IMGUI_SDF_PADDING 4
+#define IMGUI_SDF_ON_EDGE 128
+
+static array<ImFont*> _sdf_fonts{};
+
+static bool _is_sdf_font(const ImFont *font)
+{
+    for_array(f, &_sdf_fonts)
+        if (*f == font)
+            return true;
+
+    return false;
+}
+
+ImFont *imgui_add_sdf_font_from_file(const char *path, float size_pixels, const ImFontConfig *config, const ImWchar *glyph_ranges)
+{
+    ImFont *font = imgui_add_font_from_file(path, size_pixels, config, glyph_ranges);
+
+    if (font != nullptr && !_is_sdf_font(font))
+        *add_at_end(&_sdf_fonts) = font;
+
+    return font;
+}
+
+bool imgui_is_sdf_font(const ImFont *font)
+{
+    return _is_sdf_font(font);
+}
+
+/* Atlas cache
+
+After building, the atlas is written to
+$XDG_CACHE_HOME/window-base/imgui_atlas_<key>.cache on Linux (or
+$HOME/.cache/window-base/...), %LOCALAPPDATA%\window-base\... on Windows.
+The key is a hash of everything the atlas depends on:
+- every font config (size, oversampling, offsets, glyph ranges, ...) and
+  whether its font is an SDF font. content scale is part of the font sizes.
+- the path, size and modification time of fonts added with
+  imgui_add_font_from_file, the data itself for other fonts (e.g. the
+  default font, which is small).
+- the custom rects, the atlas flags and the ImGui version.
+so a file that exists for a key can be loaded without checking anything else.
+
+File layout:
+
+    imgui_atlas_header
+    imgui_atlas_rect[rect_count]     positions of the custom rects
+    imgui_atlas_font[font_count]     metrics of atlas->Fonts[i]
+    imgui_atlas_glyph[glyph_count]   glyphs of all fonts, each font owns
+                                     glyph_count glyphs, in font order
+    u8[tex_width * tex_height]       alpha texture
+
+Loading does what the font builder would do, without rasterizing: set up the
+fonts, add the glyphs and let ImFontAtlasBuildFinish add the custom rect
+glyphs and build the lookup tables. Glyphs of custom rects are not stored
+for that reason.
+Atlases with colored glyphs (only with FreeType) are not cached since only
+the alpha texture is stored.
+Loaded files are checked against the atlas (rects and UVs in the texture)
+before anything is written at the positions they contain.
+
+Every key gets a file of its own, so after writing one, all but the
+IMGUI_ATLAS_MAX_FILES most recently used are removed (loading a file marks
+it as used), as are temporary files of writes that never finished.
+*/
+#define IMGUI_ATLAS_MAGIC     0x53414749 // "IGAS"
+#define IMGUI_ATLAS_VERSION   3
+#define IMGUI_ATLAS_DIR       "window-base"
+#define IMGUI_ATLAS_MAX_FILES 4
+#define IMGUI_ATLAS_TMP_SECONDS (60 * 60) // temporary files older than this are left over
+
+struct imgui_atlas_header
+{
+    u32 magic;
+    u32 version;
+    u64 key;
+    s32 tex_width;
+    s32 tex_height;
+    s32 rect_count;
+    s32 font_count;
+    s32 glyph_count;
+    s32 _padding;
+};
+
+struct imgui_atlas_rect
+{
+    u16 x;
+    u16 y;
+};
+
+struct imgui_atlas_font
+{
+    float ascent;
+    float descent;
+    s32 glyph_count;
+};
+
+struct imgui_atlas_glyph
+{
+    u32 codepoint;
+    float advance_x;
+    float x0, y0, x1, y1;
+    float u0, v0, u1, v1;
+};
+
+static u64 _atlas_hash(u64 h, const void *data, s64 size)
+{
+    const u8 *p = (const u8*)data;
+
+    for (s64 i = 0; i < size; ++i)
+    {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+
+    return h;
+}
+
+#define _atlas_hash_value(H, V) _atlas_hash(H, &(V), sizeof(V))
+
+static const imgui_font_file *_find_font_file_by_data(const void *data)
+{
+    for_array(file, &_font_files)
+        if (file->data == data)
+            return file;
+
+    return nullptr;
+}
+
+static u64 _atlas_key(ImFontAtlas *atlas)
+{
+    u64 h = 0xcbf29ce484222325ull;
+    int version = IMGUI_VERSION_NUM;
+    h = _atlas_hash_value(h, version);
+    h = _atlas_hash_value(h, atlas->Flags);
+    h = _atlas_hash_value(h, atlas->TexDesiredWidth);
+    h = _atlas_hash_value(h, atlas->TexGlyphPadding);
+
+    for (int i = 0; i < atlas->ConfigData.Size; ++i)
+    {
+        const ImFontConfig *cfg = &atlas->ConfigData[i];
+
+        // the constructor clears the whole config, so hashing the bytes is
+        // fine once the pointers are cleared.
+        ImFontConfig c = *cfg;
+        c.FontData = nullptr;
+        c.GlyphRanges = nullptr;
+        c.DstFont = nullptr;
+        c.FontDataOwnedByAtlas = false;
+        h = _atlas_hash_value(h, c);
+
+        // which font a config belongs to
+        int font_index = atlas->Fonts.find_index(cfg->DstFont);
+        h = _atlas_hash_value(h, font_index);
+
+        bool sdf = _is_sdf_font(cfg->DstFont);
+        h = _atlas_hash_value(h, sdf);
+
+        const ImWchar *ranges = cfg->GlyphRanges != nullptr ? cfg->GlyphRanges : atlas->GetGlyphRangesDefault();
+
+        for (; ranges[0] != 0; ranges += 2)
+            h = _atlas_hash(h, ranges, sizeof(ImWchar) * 2);
+
+        // fonts of imgui_add_font_from_file are keyed by file, others (e.g.
+        // AddFontFromMemoryTTF) by their bytes.
+        const imgui_font_file *file = _find_font_file_by_data(cfg->FontData);
+
+        if (file != nullptr)
+        {
+            h = _atlas_hash(h, file->path.data, file->path.size);
+            h = _atlas_hash_value(h, file->size);
+            h = _atlas_hash_value(h, file->mtime);
+        }
+        else
+            h = _atlas_hash(h, cfg->FontData, cfg->FontDataSize);
+    }
+
+    for (int i = 0; i < atlas->CustomRects.Size; ++i)
+    {
+        const ImFontAtlasCustomRect *rect = &atlas->CustomRects[i];
+        int font_index = rect->Font != nullptr ? atlas->Fonts.find_index(rect->Font) : -1;
+        h = _atlas_hash_value(h, rect->Width);
+        h = _atlas_hash_value(h, rect->Height);
+        h = _atlas_hash_value(h, rect->GlyphID);
+        h = _atlas_hash_value(h, font_index);
+    }
+
+    return h;
+}
+
+// the directory of the cache files, with a trailing separator
+static bool _get_atlas_cache_dir(string *out)
+{
+#if Windows
+    const char *base = getenv("LOCALAPPDATA");
+
+    if (base == nullptr || base[0] == '\0')
+        return false;
+
+    string_set(out, base);
+    string_append(out, "\\" IMGUI_ATLAS_DIR);
+    CreateDirectoryA(out->data, nullptr); // fails if it exists, fine
+    string_append(out, "\\");
+#elif Linux
+    const char *xdg_cache = getenv("XDG_CACHE_HOME");
+
+    if (xdg_cache != nullptr && xdg_cache[0] != '\0')
+        string_set(out, xdg_cache);
+    else
+    {
+        const char *home = getenv("HOME");
+
+        if (home == nullptr || home[0] == '\0')
+            return false;
+
+        string_set(out, home);
+        string_append(out, "/.cache");
+    }
+
+    // failing is fine if they already exist
+    mkdir(out->data, 0755);
+    string_append(out, "/" IMGUI_ATLAS_DIR);
+    mkdir(out->data, 0755);
+    string_append(out, "/");
+#endif
+
+    return true;
+}
+
+static bool _get_atlas_cache_path(u64 key, string *out)
+{
+    if (!_get_atlas_cache_dir(out))
+        return false;
+
+    char name[64];
+    snprintf(name, sizeof(name), "imgui_atlas_%016llx.cache", (unsigned long long)key);
+    string_append(out, name);
+
+    return true;
+}
+
+static bool _is_custom_rect_glyph(ImFontAtlas *atlas, const ImFont *font, u32 codepoint)
+{
+    for (int i = 0; i < atlas->CustomRects.Size; ++i)
+        if (atlas->CustomRects[i].Font == font && atlas->CustomRects[i].GlyphID == codepoint)
+            return true;
+
+    return false;
+}
+
+struct imgui_atlas_cache_file
+{
+    string path;
+    s64 mtime;
+};
+
+static int _compare_atlas_cache_files(const imgui_atlas_cache_file *lhs, const imgui_atlas_cache_file *rhs)
+{
+    // most recently used first
+    if (lhs->mtime > rhs->mtime) return -1;
+    if (lhs->mtime < rhs->mtime) return  1;
+
+    return 0;
+}
+
+// marks a loaded file as used, see _prune_atlas_cache
+static void _touch_atlas_cache_file(const char *path)
+{
+#if Windows
+    HANDLE file = CreateFileA(path, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    SetFileTime(file, nullptr, nullptr, &now);
+    CloseHandle(file);
+#elif Linux
+    utimensat(AT_FDCWD, path, nullptr, 0);
+#endif
+}
+
+// removes all but the IMGUI_ATLAS_MAX_FILES most recently used cache files,
+// and temporary files older than IMGUI_ATLAS_TMP_SECONDS.
+static void _prune_atlas_cache()
+{
+    string dir{};
+    defer { free(&dir); };
+
+    if (!_get_atlas_cache_dir(&dir))
+        return;
+
+    array<imgui_atlas_cache_file> files{};
+    defer
+    {
+        for_array(f, &files)
+            free(&f->path);
+
+        free(&files);
+    };
+
+#if Windows
+    FILETIME now_ft;
+    GetSystemTimeAsFileTime(&now_ft);
+    s64 now = (s64)(((u64)now_ft.dwHighDateTime << 32) | now_ft.dwLowDateTime) / 10000000;
+
+    const char *patterns[] = {"imgui_atlas_*.cache", "iga*.tmp"};
+
+    for (int p = 0; p < 2; ++p)
+    {
+        string pattern{};
+        defer { free(&pattern); };
+        string_set(&pattern, to_const_string(dir));
+        string_append(&pattern, patterns[p]);
+
+        WIN32_FIND_DATAA entry;
+        HANDLE find = FindFirstFileA(pattern.data, &entry);
+
+        if (find == INVALID_HANDLE_VALUE)
+            continue;
+
+        do
+        {
+            string path{};
+            string_set(&path, to_const_string(dir));
+            string_append(&path, entry.cFileName);
+
+            s64 mtime = (s64)(((u64)entry.ftLastWriteTime.dwHighDateTime << 32) | entry.ftLastWriteTime.dwLowDateTime) / 10000000;
+
+            if (p == 1)
+            {
+                if (now - mtime > IMGUI_ATLAS_TMP_SECONDS)
+                    DeleteFileA(path.data);
+
+                free(&path);
+                continue;
+            }
+
+            imgui_atlas_cache_file *f = add_at_end(&files);
+            f->path = path;
+            f->mtime = mtime;
+        }
+        while (FindNextFileA(find, &entry));
+
+        FindClose(find);
+    }
+#elif Linux
+    DIR *d = opendir(dir.data);
+
+    if (d == nullptr)
+        return;
+
+    s64 now = (s64)time(nullptr);
+
+    while (dirent *entry = readdir(d))
+    {
+        const_string name = to_const_string(entry->d_name);
+
+        if (!string_begins_with(name, "imgui_atlas_"_cs))
+            continue;
+
+        string path{};
+        string_set(&path, to_const_string(dir));
+        string_append(&path, name);
+
+        struct stat st;
+
+        if (stat(path.data, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            free(&path);
+            continue;
+        }
+
+        // temporary files are <name>.cache.XXXXXX
+        if (!string_ends_with(name, ".cache"_cs))
+        {
+            if (now - (s64)st.st_mtime > IMGUI_ATLAS_TMP_SECONDS)
+                unlink(path.data);
+
+            free(&path);
+            continue;
+        }
+
+        imgui_atlas_cache_file *f = add_at_end(&files);
+        f->path = path;
+        f->mtime = (s64)st.st_mtime;
+    }
+
+    closedir(d);
+#endif
+
+    if (files.size <= IMGUI_ATLAS_MAX_FILES)
+        return;
+
+    sort(files.data, files.size, _compare_atlas_cache_files);
+
+    for (s64 i = IMGUI_ATLAS_MAX_FILES; i < files.size; ++i)
+        remove(files[i].path.data);
+}
+
+static void _write_atlas_cache(ImFontAtlas *atlas, u64 key)
+{
+    if (atlas->TexPixelsAlpha8 == nullptr)
+        return;
+
+    imgui_atlas_header header{};
+    header.magic = IMGUI_ATLAS_MAGIC;
+    header.version = IMGUI_ATLAS_VERSION;
+    header.key = key;
+    header.tex_width = atlas->TexWidth;
+    header.tex_height = atlas->TexHeight;
+    header.rect_count = atlas->CustomRects.Size;
+    header.font_count = atlas->Fonts.Size;
+
+    for (int f = 0; f < atlas->Fonts.Size; ++f)
+    {
+        const ImFont *font = atlas->Fonts[f];
+
+        for (int g = 0; g < font->Glyphs.Size; ++g)
+        {
+            if (font->Glyphs[g].Colored)
+                return;
+
+            if (!_is_custom_rect_glyph(atlas, font, font->Glyphs[g].Codepoint))
+                header.glyph_count += 1;
+        }
+    }
+
+    string path{};
+    defer { free(&path); };
+
+    if (!_get_atlas_cache_path(key, &path))
+        return;
+
+    // write to a temporary file first, then rename, so other processes never
+    // read a partially written cache. The name is unique so processes writing
+    // at the same time don't write to the same file.
+    string tmp_path{};
+    defer { free(&tmp_path); };
+
+#if Windows
+    string dir{};
+    defer { free(&dir); };
+
+    if (!_get_atlas_cache_dir(&dir))
+        return;
+
+    char tmp_name[MAX_PATH];
+
+    if (GetTempFileNameA(dir.data, "iga", 0, tmp_name) == 0)
+        return;
+
+    string_set(&tmp_path, tmp_name);
+    FILE *file = fopen(tmp_path.data, "wb");
+#elif Linux
+    string_set(&tmp_path, to_const_string(path));
+    string_append(&tmp_path, ".XXXXXX");
+
+    int fd = mkstemp(tmp_path.data);
+
+    if (fd < 0)
+        return;
+
+    fchmod(fd, 0644);
+    FILE *file = fdopen(fd, "wb");
+
+    if (file == nullptr)
+        close(fd);
+#endif
+
+    if (file == nullptr)
+    {
+        remove(tmp_path.data);
+        return;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (int i = 0; ok && i < atlas->CustomRects.Size; ++i)
+    {
+        imgui_atlas_rect rect{atlas->CustomRects[i].X, atlas->CustomRects[i].Y};
+        ok = fwrite(&rect, sizeof(rect), 1, file) == 1;
+    }
+
+    for (int f = 0; ok && f < atlas->Fonts.Size; ++f)
+    {
+        const ImFont *font = atlas->Fonts[f];
+        imgui_atlas_font ifont{font->Ascent, font->Descent, 0};
+
+        for (int g = 0; g < font->Glyphs.Size; ++g)
+            if (!_is_custom_rect_glyph(atlas, font, font->Glyphs[g].Codepoint))
+                ifont.glyph_count += 1;
+
+        ok = fwrite(&ifont, sizeof(ifont), 1, file) == 1;
+    }
+
+    for (int f = 0; ok && f < atlas->Fonts.Size; ++f)
+    {
+        const ImFont *font = atlas->Fonts[f];
+
+        for (int g = 0; ok && g < font->Glyphs.Size; ++g)
+        {
+            const ImFontGlyph *src = &font->Glyphs[g];
+
+            if (_is_custom_rect_glyph(atlas, font, src->Codepoint))
+                continue;
+
+            imgui_atlas_glyph glyph{};
+            glyph.codepoint = src->Codepoint;
+            glyph.advance_x = src->AdvanceX;
+            glyph.x0 = src->X0; glyph.y0 = src->Y0; glyph.x1 = src->X1; glyph.y1 = src->Y1;
+            glyph.u0 = src->U0; glyph.v0 = src->V0; glyph.u1 = src->U1; glyph.v1 = src->V1;
+            ok = fwrite(&glyph, sizeof(glyph), 1, file) == 1;
+        }
+    }
+
+    s64 pixel_count = (s64)atlas->TexWidth * atlas->TexHeight;
+    ok = ok && fwrite(atlas->TexPixelsAlpha8, 1, (size_t)pixel_count, file) == (size_t)pixel_count;
+    ok = fclose(file) == 0 && ok;
+
+#if Windows
+    ok = ok && MoveFileExA(tmp_path.data, path.data, MOVEFILE_REPLACE_EXISTING);
+#elif Linux
+    ok = ok && rename(tmp_path.data, path.data) == 0;
+#endif
+
+    if (!ok)
+        remove(tmp_path.data);
+    else
+        _prune_atlas_cache();
+}
+
+static bool _read_file(const char *path, array<u8> *out)
+{
+    FILE *file = fopen(path, "rb");
+
+    if (file == nullptr)
+        return false;
+
+    defer { fclose(file); };
+
+    if (fseek(file, 0, SEEK_END) != 0)
+        return false;
+
+    long size = ftell(file);
+
+    if (size <= 0 || fseek(file, 0, SEEK_SET) != 0)
+        return false;
+
+    if (!reserve(out, size))
+        return false;
+
+    out->size = size;
+    return fread(out->data, 1, (size_t)size, file) == (size_t)size;
+}
+
+// incremented whenever the atlas pixels are made anew (built or loaded), a
+// rebuilt atlas may get its pixels at the same address again.
+static u64 _atlas_generation = 0;
+
+static bool _load_atlas_cache(ImFontAtlas *atlas, u64 key)
+{
+    string path{};
+    defer { free(&path); };
+
+    if (!_get_atlas_cache_path(key, &path))
+        return false;
+
+    array<u8> data{};
+    defer { free(&data); };
+
+    if (!_read_file(path.data, &data) || data.size < (s64)sizeof(imgui_atlas_header))
+        return false;
+
+    const imgui_atlas_header *header = (const imgui_atlas_header*)data.data;
+
+    if (header->magic != IMGUI_ATLAS_MAGIC
+     || header->version != IMGUI_ATLAS_VERSION
+     || header->key != key
+     || header->rect_count != atlas->CustomRects.Size
+     || header->font_count != atlas->Fonts.Size
+     || header->tex_width <= 0 || header->tex_height <= 0 || header->glyph_count < 0)
+        return false;
+
+    s64 rects_offset  = sizeof(imgui_atlas_header);
+    s64 fonts_offset  = rects_offset + (s64)sizeof(imgui_atlas_rect) * header->rect_count;
+    s64 glyphs_offset = fonts_offset + (s64)sizeof(imgui_atlas_font) * header->font_count;
+    s64 pixels_offset = glyphs_offset + (s64)sizeof(imgui_atlas_glyph) * header->glyph_count;
+    s64 pixel_count = (s64)header->tex_width * header->tex_height;
+
+    if (pixels_offset + pixel_count != data.size)
+        return false;
+
+    const imgui_atlas_rect *rects = (const imgui_atlas_rect*)(data.data + rects_offset);
+    const imgui_atlas_font *fonts = (const imgui_atlas_font*)(data.data + fonts_offset);
+    const imgui_atlas_glyph *glyphs = (const imgui_atlas_glyph*)(data.data + glyphs_offset);
+
+    s64 glyph_total = 0;
+
+    for (int f = 0; f < header->font_count; ++f)
+    {
+        if (fonts[f].glyph_count < 0)
+            return false;
+
+        glyph_total += fonts[f].glyph_count;
+    }
+
+    if (glyph_total != header->glyph_count)
+        return false;
+
+    for (int i = 0; i < atlas->ConfigData.Size; ++i)
+    {
+        int f = atlas->Fonts.find_index(atlas->ConfigData[i].DstFont);
+
+        if (f < 0 || f >= header->font_count)
+            return false;
+    }
+
+    // the rects are written to at these positions (custom rect glyphs,
+    // dynamic glyphs), a stale or corrupt file must not point outside.
+    for (int i = 0; i < header->rect_count; ++i)
+        if ((s64)rects[i].x + atlas->CustomRects[i].Width > header->tex_width
+         || (s64)rects[i].y + atlas->CustomRects[i].Height > header->tex_height)
+            return false;
+
+    for (s64 i = 0; i < header->glyph_count; ++i)
+    {
+        const imgui_atlas_glyph *g = glyphs + i;
+
+        // also false for NaN
+        if (!(g->u0 >= 0.0f && g->u0 <= 1.0f && g->u1 >= 0.0f && g->u1 <= 1.0f
+           && g->v0 >= 0.0f && g->v0 <= 1.0f && g->v1 >= 0.0f && g->v1 <= 1.0f))
+            return false;
+    }
+
+    _touch_atlas_cache_file(path.data);
+
+    // same as the start of the font builder
+    atlas->ClearTexData();
+    _atlas_generation += 1;
+    atlas->TexWidth = header->tex_width;
+    atlas->TexHeight = header->tex_height;
+    atlas->TexUvScale = ImVec2(1.0f / atlas->TexWidth, 1.0f / atlas->TexHeight);
+    atlas->TexPixelsAlpha8 = (unsigned char*)IM_ALLOC((size_t)pixel_count);
+    copy_memory(data.data + pixels_offset, atlas->TexPixelsAlpha8, pixel_count);
+
+    for (int i = 0; i < header->rect_count; ++i)
+    {
+        atlas->CustomRects[i].X = rects[i].x;
+        atlas->CustomRects[i].Y = rects[i].y;
+    }
+
+    for (int i = 0; i < atlas->ConfigData.Size; ++i)
+    {
+        ImFontConfig *cfg = &atlas->ConfigData[i];
+        int f = atlas->Fonts.find_index(cfg->DstFont);
+        ImFontAtlasBuildSetupFont(atlas, cfg->DstFont, cfg, fonts[f].ascent, fonts[f].descent);
+    }
+
+    const imgui_atlas_glyph *glyph = glyphs;
+
+    for (int f = 0; f < header->font_count; ++f)
+    {
+        ImFont *font = atlas->Fonts[f];
+
+        // values are final, no config adjusts them again
+        for (int g = 0; g < fonts[f].glyph_count; ++g, ++glyph)
+            font->AddGlyph(nullptr, (ImWchar)glyph->codepoint,
+                           glyph->x0, glyph->y0, glyph->x1, glyph->y1,
+                           glyph->u0, glyph->v0, glyph->u1, glyph->v1,
+                           glyph->advance_x);
+    }
+
+    ImFontAtlasBuildFinish(atlas);
+
+    return true;
+}
+
+// black instead of white in the RGBA texture for the texels of SDF glyphs,
+// the RGBA texture is created here if there are SDF fonts.
+static void _mark_sdf_glyphs(ImFontAtlas *atlas)
+{
+    if (_sdf_fonts.size == 0 || atlas->TexPixelsAlpha8 == nullptr)
+        return;
+
+    int w = atlas->TexWidth;
+    int h = atlas->TexHeight;
+
+    if (atlas->TexPixelsRGBA32 == nullptr)
+    {
+        // same as ImFontAtlas::GetTexDataAsRGBA32
+        atlas->TexPixelsRGBA32 = (unsigned int*)IM_ALLOC((size_t)w * h * 4);
+
+        for (s64 i = 0; i < (s64)w * h; ++i)
+            atlas->TexPixelsRGBA32[i] = IM_COL32(255, 255, 255, atlas->TexPixelsAlpha8[i]);
+    }
+
+    for (int i = 0; i < atlas->Fonts.Size; ++i)
+    {
+        const ImFont *font = atlas->Fonts[i];
+
+        if (!_is_sdf_font(font))
+            continue;
+
+        for (int g = 0; g < font->Glyphs.Size; ++g)
+        {
+            const ImFontGlyph *glyph = &font->Glyphs[g];
+
+            if (_is_custom_rect_glyph(atlas, font, glyph->Codepoint))
+                continue;
+
+            int x0 = (int)(glyph->U0 * w + 0.5f);
+            int y0 = (int)(glyph->V0 * h + 0.5f);
+            int x1 = (int)(glyph->U1 * w + 0.5f);
+            int y1 = (int)(glyph->V1 * h + 0.5f);
+
+            for (int y = y0; y < y1; ++y)
+            for (int x = x0; x < x1; ++x)
+                atlas->TexPixelsRGBA32[(s64)y * w + x] &= IM_COL32(0, 0, 0, 255);
+        }
+    }
+}
+
+/* Parallel atlas builder
+
+Builds the atlas like the stb_truetype builder of ImGui (imgui_draw.cpp,
+ImFontAtlasBuildWithStbTruetype), with the same steps and the same results,
+except that the glyphs are rasterized by a pool of threads:
+
+1. find the glyphs of every config, in config order, skipping glyphs an
+   earlier config of the same font already has.
+2. measure and pack all glyphs and the custom rects into the texture.
+3. rasterize the glyphs, split into jobs of IMGUI_BUILD_GLYPHS_PER_JOB
+   glyphs of one config. Every glyph is rasterized into its own packed
+   rectangle of the texture and every job writes its own glyph outputs, so
+   the jobs share nothing but the read-only font data, and the order they run
+   in doesn't matter.
+4. set up the fonts and add the glyphs, in config order.
+
+Glyphs of SDF fonts are measured and rasterized for stbtt_GetGlyphSDF
+instead, see SDF fonts.
+Everything except 3 happens on the calling thread, so the atlas is the same
+no matter how many threads there are: every pixel and glyph is identical to
+a build with imgui_set_font_build_threads(1).
+stb_truetype allocates its temporary buffers with malloc here, ImGui's
+allocator isn't thread safe.
+
+The builder is set as the FontBuilderIO of the atlas, so ImGui uses it as
+well when it builds the atlas itself. Atlases with a different builder
+(e.g. FreeType) are left alone.
+*/
+#define IMGUI_BUILD_MAX_THREADS    32
+#define IMGUI_BUILD_GLYPHS_PER_JOB 64
+
+struct imgui_build_src
+{
+    bool sdf;
+    float scale;
+    stbtt_fontinfo info;
+    stbtt_pack_range range;
+    stbrp_rect *rects;
+    stbtt_packedchar *packed_chars;
+    const ImWchar *glyph_ranges;
+    int glyphs_highest;
+    ImBitVector glyph_set;
+    ImVector<int> glyphs;
+};
+
+struct imgui_build_dst
+{
+    int glyphs_highest;
+    ImBitVector glyph_set;
+};
+
+struct imgui_raster_job
+{
+    int src;
+    int first;   // glyph index within src
+    int count;
+};
+
+struct imgui_raster_pool
+{
+    ImFontAtlas *atlas;
+    imgui_build_src *srcs;
+    const stbtt_pack_context *pack;
+    const imgui_raster_job *jobs;
+    s64 job_count;
+    s64 next_job;
+};
+
+static int _font_build_threads = 0;
+
+static bool _init_font_info(stbtt_fontinfo *info, const void *data, int font_no)
+{
+    const unsigned char *d = (const unsigned char*)data;
+    int offset = stbtt_GetFontOffsetForIndex(d, font_no);
+
+    return offset >= 0 && stbtt_InitFont(info, d, offset) != 0;
+}
+
+static int _get_font_build_threads()
+{
+    int count = _font_build_threads;
+
+    if (count <= 0)
+    {
+#if Windows
+        count = (int)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+#elif Linux
+        count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    }
+
+    if (count < 1)
+        count = 1;
+
+    if (count > IMGUI_BUILD_MAX_THREADS)
+        count = IMGUI_BUILD_MAX_THREADS;
+
+    return count;
+}
+
+// like stbtt_PackFontRangesRenderIntoRects, but with stbtt_GetGlyphSDF.
+static void _rasterize_sdf_job(imgui_raster_pool *pool, const imgui_raster_job *job)
+{
+    ImFontAtlas *atlas = pool->atlas;
+    imgui_build_src *src = pool->srcs + job->src;
+    int padding = pool->pack->padding;
+
+    for (int i = job->first; i < job->first + job->count; ++i)
+    {
+        stbrp_rect *r = src->rects + i;
+        stbtt_packedchar *pc = src->packed_chars + i;
+        int glyph = stbtt_FindGlyphIndex(&src->info, src->glyphs[i]);
+
+        int advance = 0;
+        int lsb = 0;
+        stbtt_GetGlyphHMetrics(&src->info, glyph, &advance, &lsb);
+        pc->xadvance = src->scale * advance;
+
+        if (!r->was_packed || r->w == 0 || r->h == 0)
+            continue;
+
+        // the padding is on the left and top
+        r->x += padding;
+        r->y += padding;
+        r->w -= padding;
+        r->h -= padding;
+
+        int w = 0;
+        int h = 0;
+        int xoff = 0;
+        int yoff = 0;
+        unsigned char *sdf = stbtt_GetGlyphSDF(&src->info, src->scale, glyph, IMGUI_SDF_PADDING, IMGUI_SDF_ON_EDGE,
+                                               (float)IMGUI_SDF_ON_EDGE / IMGUI_SDF_PADDING, &w, &h, &xoff, &yoff);
+
+        if (sdf == nullptr)
+            continue;
+
+        w = ImMin(w, (int)r->w);
+        h = ImMin(h, (int)r->h);
+
+        for (int row = 0; row < h; ++row)
+            copy_memory(sdf + (s64)row * w, atlas->TexPixelsAlpha8 + (s64)(r->y + row) * atlas->TexWidth + r->x, w);
+
+        stbtt_FreeSDF(sdf, nullptr);
+
+        pc->x0 = (unsigned short)r->x;
+        pc->y0 = (unsigned short)r->y;
+        pc->x1 = (unsigned short)(r->x + w);
+        pc->y1 = (unsigned short)(r->y + h);
+        pc->xoff = (float)xoff;
+        pc->yoff = (float)yoff;
+        pc->xoff2 = (float)(xoff + w);
+        pc->yoff2 = (float)(yoff + h);
+    }
+}
+
+static void _rasterize_job(imgui_raster_pool *pool, const imgui_raster_job *job)
+{
+    ImFontAtlas *atlas = pool->atlas;
+    imgui_build_src *src = pool->srcs + job->src;
+    const ImFontConfig *cfg = &atlas->ConfigData[job->src];
+
+    if (src->sdf)
+    {
+        _rasterize_sdf_job(pool, job);
+        return;
+    }
+
+    // stbtt_PackFontRangesRenderIntoRects sets the oversampling of the
+    // context, so every job gets its own copy.
+    stbtt_pack_context pack = *pool->pack;
+
+    stbtt_pack_range range = src->range;
+    range.array_of_unicode_codepoints = src->glyphs.Data + job->first;
+    range.num_chars = job->count;
+    range.chardata_for_range = src->packed_chars + job->first;
+
+    stbrp_rect *rects = src->rects + job->first;
+
+    stbtt_PackFontRangesRenderIntoRects(&pack, &src->info, &range, 1, rects);
+
+    if (cfg->RasterizerMultiply != 1.0f)
+    {
+        unsigned char multiply_table[256];
+        ImFontAtlasBuildMultiplyCalcLookupTable(multiply_table, cfg->RasterizerMultiply);
+
+        for (int i = 0; i < job->count; ++i)
+            if (rects[i].was_packed)
+                ImFontAtlasBuildMultiplyRectAlpha8(multiply_table, atlas->TexPixelsAlpha8, rects[i].x, rects[i].y, rects[i].w, rects[i].h, atlas->TexWidth);
+    }
+}
+
+#if Windows
+static DWORD WINAPI _raster_worker(LPVOID _pool)
+#elif Linux
+static void *_raster_worker(void *_pool)
+#endif
+{
+    imgui_raster_pool *pool = (imgui_raster_pool*)_pool;
+
+    while (true)
+    {
+#if Windows
+        s64 i = (s64)InterlockedIncrement64((LONG64*)&pool->next_job) - 1;
+#elif Linux
+        s64 i = __atomic_fetch_add(&pool->next_job, 1, __ATOMIC_RELAXED);
+#endif
+
+        if (i >= pool->job_count)
+            break;
+
+        _rasterize_job(pool, pool->jobs + i);
+    }
+
+#if Windows
+    return 0;
+#elif Linux
+    return nullptr;
+#endif
+}
+
+// runs all jobs, the calling thread is one of the workers.
+static void _rasterize_parallel(imgui_raster_pool *pool)
+{
+    s64 thread_count = _get_font_build_threads();
+
+    if (thread_count > pool->job_count)
+        thread_count = pool->job_count;
+
+#if Windows
+    HANDLE threads[IMGUI_BUILD_MAX_THREADS];
+#elif Linux
+    pthread_t threads[IMGUI_BUILD_MAX_THREADS];
+#endif
+    s64 started = 0;
+
+    // if a thread can't be started, the others just do more jobs
+    for (; started < thread_count - 1; ++started)
+    {
+#if Windows
+        threads[started] = CreateThread(nullptr, 0, _raster_worker, pool, 0, nullptr);
+
+        if (threads[started] == nullptr)
+            break;
+#elif Linux
+        if (pthread_create(threads + started, nullptr, _raster_worker, pool) != 0)
+            break;
+#endif
+    }
+
+    _raster_worker(pool);
+
+    for (s64 i = 0; i < started; ++i)
+    {
+#if Windows
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#elif Linux
+        pthread_join(threads[i], nullptr);
+#endif
+    }
+}
+
+static void _unpack_glyph_set(const ImBitVector *set, ImVector<int> *out)
+{
+    for (int i = 0; i < set->Storage.Size; ++i)
+    {
+        ImU32 bits = set->Storage[i];
+
+        for (int bit = 0; bits != 0 && bit < 32; ++bit)
+            if (bits & ((ImU32)1 << bit))
+                out->push_back(i * 32 + bit);
+    }
+}
+
+static bool _build_atlas_parallel(ImFontAtlas *atlas)
+{
+    IM_ASSERT(atlas->ConfigData.Size > 0);
+
+    ImFontAtlasBuildInit(atlas);
+
+    atlas->TexID = (ImTextureID)0;
+    atlas->TexWidth = atlas->TexHeight = 0;
+    atlas->TexUvScale = ImVec2(0.0f, 0.0f);
+    atlas->TexUvWhitePixel = ImVec2(0.0f, 0.0f);
+    atlas->ClearTexData();
+    _atlas_generation += 1;
+
+    int src_count = atlas->ConfigData.Size;
+    ImVector<imgui_build_src> srcs;
+    ImVector<imgui_build_dst> dsts;
+    srcs.resize(src_count, imgui_build_src{});
+    dsts.resize(atlas->Fonts.Size, imgui_build_dst{});
+
+    // 1. glyphs of every config
+    for (int i = 0; i < src_count; ++i)
+    {
+        imgui_build_src *src = &srcs[i];
+        ImFontConfig *cfg = &atlas->ConfigData[i];
+        int dst_index = atlas->Fonts.find_index(cfg->DstFont);
+
+        if (dst_index < 0)
+        {
+            IM_ASSERT(0 && "ImFontConfig::DstFont is not a font of the atlas");
+            return false;
+        }
+
+        if (!_init_font_info(&src->info, cfg->FontData, cfg->FontNo))
+        {
+            IM_ASSERT(0 && "could not parse font data");
+            return false;
+        }
+
+        src->glyph_ranges = cfg->GlyphRanges != nullptr ? cfg->GlyphRanges : atlas->GetGlyphRangesDefault();
+
+        for (const ImWchar *r = src->glyph_ranges; r[0] != 0 && r[1] != 0; r += 2)
+            src->glyphs_highest = ImMax(src->glyphs_highest, (int)r[1]);
+
+        imgui_build_dst *dst = &dsts[dst_index];
+        dst->glyphs_highest = ImMax(dst->glyphs_highest, src->glyphs_highest);
+    }
+
+    int total_glyphs = 0;
+
+    for (int i = 0; i < src_count; ++i)
+    {
+        imgui_build_src *src = &srcs[i];
+        imgui_build_dst *dst = &dsts[atlas->Fonts.find_index(atlas->ConfigData[i].DstFont)];
+
+        src->glyph_set.Create(src->glyphs_highest + 1);
+
+        if (dst->glyph_set.Storage.Size == 0)
+            dst->glyph_set.Create(dst->glyphs_highest + 1);
+
+        for (const ImWchar *r = src->glyph_ranges; r[0] != 0 && r[1] != 0; r += 2)
+        for (unsigned int c = r[0]; c <= r[1]; ++c)
+        {
+            if (dst->glyph_set.TestBit((int)c) || stbtt_FindGlyphIndex(&src->info, (int)c) == 0)
+                continue;
+
+            src->glyph_set.SetBit((int)c);
+            dst->glyph_set.SetBit((int)c);
+            total_glyphs += 1;
+        }
+
+        _unpack_glyph_set(&src->glyph_set, &src->glyphs);
+        src->glyph_set.Clear();
+    }
+
+    for (int i = 0; i < dsts.Size; ++i)
+        dsts[i].glyph_set.Clear();
+
+    // 2. measure and pack
+    ImVector<stbrp_rect> rects;
+    ImVector<stbtt_packedchar> packed_chars;
+    rects.resize(total_glyphs);
+    packed_chars.resize(total_glyphs);
+    fill_memory(rects.Data, 0, rects.size_in_bytes());
+    fill_memory(packed_chars.Data, 0, packed_chars.size_in_bytes());
+
+    int padding = atlas->TexGlyphPadding;
+    int total_surface = 0;
+    int offset = 0;
+
+    for (int i = 0; i < src_count; ++i)
+    {
+        imgui_build_src *src = &srcs[i];
+        ImFontConfig *cfg = &atlas->ConfigData[i];
+        int count = src->glyphs.Size;
+
+        if (count == 0)
+            continue;
+
+        src->rects = rects.Data + offset;
+        src->packed_chars = packed_chars.Data + offset;
+        offset += count;
+
+        float size = cfg->SizePixels * cfg->RasterizerDensity;
+        src->range.font_size = size;
+        src->range.first_unicode_codepoint_in_range = 0;
+        src->range.array_of_unicode_codepoints = src->glyphs.Data;
+        src->range.num_chars = count;
+        src->range.chardata_for_range = src->packed_chars;
+        src->range.h_oversample = (unsigned char)cfg->OversampleH;
+        src->range.v_oversample = (unsigned char)cfg->OversampleV;
+
+        src->scale = size > 0.0f ? stbtt_ScaleForPixelHeight(&src->info, size)
+                                 : stbtt_ScaleForMappingEmToPixels(&src->info, -size);
+
+        src->sdf = _is_sdf_font(cfg->DstFont);
+
+        for (int g = 0; g < count; ++g)
+        {
+            int x0, y0, x1, y1;
+            int glyph = stbtt_FindGlyphIndex(&src->info, src->glyphs[g]);
+
+            if (src->sdf)
+            {
+                // same box as stbtt_GetGlyphSDF
+                stbtt_GetGlyphBitmapBox(&src->info, glyph, src->scale, src->scale, &x0, &y0, &x1, &y1);
+
+                if (x0 == x1 || y0 == y1)
+                    x0 = x1 = y0 = y1 = 0;
+                else
+                {
+                    x0 -= IMGUI_SDF_PADDING;
+                    y0 -= IMGUI_SDF_PADDING;
+                    x1 += IMGUI_SDF_PADDING;
+                    y1 += IMGUI_SDF_PADDING;
+                }
+
+                src->rects[g].w = (stbrp_coord)(x1 - x0 + padding);
+                src->rects[g].h = (stbrp_coord)(y1 - y0 + padding);
+            }
+            else
+            {
+                stbtt_GetGlyphBitmapBoxSubpixel(&src->info, glyph, src->scale * cfg->OversampleH, src->scale * cfg->OversampleV, 0, 0, &x0, &y0, &x1, &y1);
+                src->rects[g].w = (stbrp_coord)(x1 - x0 + padding + cfg->OversampleH - 1);
+                src->rects[g].h = (stbrp_coord)(y1 - y0 + padding + cfg->OversampleV - 1);
+            }
+
+            total_surface += src->rects[g].w * src->rects[g].h;
+        }
+    }
+
+    int surface_sqrt = (int)ImSqrt((float)total_surface) + 1;
+
+    if (atlas->TexDesiredWidth > 0)
+        atlas->TexWidth = atlas->TexDesiredWidth;
+    else
+        atlas->TexWidth = (surface_sqrt >= 4096 * 0.7f) ? 4096 : (surface_sqrt >= 2048 * 0.7f) ? 2048 : (surface_sqrt >= 1024 * 0.7f) ? 1024 : 512;
+
+    // custom rects first, so they're in the upper left corner
+    stbtt_pack_context pack{};
+    stbtt_PackBegin(&pack, nullptr, atlas->TexWidth, 1024 * 32, 0, padding, nullptr);
+    ImFontAtlasBuildPackCustomRects(atlas, pack.pack_info);
+
+    for (int i = 0; i < src_count; ++i)
+    {
+        imgui_build_src *src = &srcs[i];
+
+        if (src->glyphs.Size == 0)
+            continue;
+
+        stbrp_pack_rects((stbrp_context*)pack.pack_info, src->rects, src->glyphs.Size);
+
+        for (int g = 0; g < src->glyphs.Size; ++g)
+            if (src->rects[g].was_packed)
+                atlas->TexHeight = ImMax(atlas->TexHeight, src->rects[g].y + src->rects[g].h);
+    }
+
+    atlas->TexHeight = (atlas->Flags & ImFontAtlasFlags_NoPowerOfTwoHeight) ? (atlas->TexHeight + 1) : ImUpperPowerOfTwo(atlas->TexHeight);
+    atlas->TexUvScale = ImVec2(1.0f / atlas->TexWidth, 1.0f / atlas->TexHeight);
+    atlas->TexPixelsAlpha8 = (unsigned char*)IM_ALLOC(atlas->TexWidth * atlas->TexHeight);
+    fill_memory(atlas->TexPixelsAlpha8, 0, atlas->TexWidth * atlas->TexHeight);
+    pack.pixels = atlas->TexPixelsAlpha8;
+    pack.height = atlas->TexHeight;
+
+    // 3. rasterize
+    array<imgui_raster_job> jobs{};
+    defer { free(&jobs); };
+
+    for (int i = 0; i < src_count; ++i)
+    for (int first = 0; first < srcs[i].glyphs.Size; first += IMGUI_BUILD_GLYPHS_PER_JOB)
+    {
+        imgui_raster_job *job = add_at_end(&jobs);
+        job->src = i;
+        job->first = first;
+        job->count = ImMin(IMGUI_BUILD_GLYPHS_PER_JOB, srcs[i].glyphs.Size - first);
+    }
+
+    imgui_raster_pool pool{};
+    pool.atlas = atlas;
+    pool.srcs = srcs.Data;
+    pool.pack = &pack;
+    pool.jobs = jobs.data;
+    pool.job_count = jobs.size;
+    pool.next_job = 0;
+
+    if (pool.job_count > 0)
+        _rasterize_parallel(&pool);
+
+    stbtt_PackEnd(&pack);
+
+    // 4. fonts and glyphs
+    for (int i = 0; i < src_count; ++i)
+    {
+        imgui_build_src *src = &srcs[i];
+        ImFontConfig *cfg = &atlas->ConfigData[i];
+        ImFont *font = cfg->DstFont;
+
+        float font_scale = stbtt_ScaleForPixelHeight(&src->info, cfg->SizePixels);
+        int unscaled_ascent, unscaled_descent, unscaled_line_gap;
+        stbtt_GetFontVMetrics(&src->info, &unscaled_ascent, &unscaled_descent, &unscaled_line_gap);
+
+        float ascent = ImTrunc(unscaled_ascent * font_scale + ((unscaled_ascent > 0.0f) ? +1 : -1));
+        float descent = ImTrunc(unscaled_descent * font_scale + ((unscaled_descent > 0.0f) ? +1 : -1));
+        ImFontAtlasBuildSetupFont(atlas, font, cfg, ascent, descent);
+
+        float off_x = cfg->GlyphOffset.x;
+        float off_y = cfg->GlyphOffset.y + IM_ROUND(font->Ascent);
+        float inv_density = 1.0f / cfg->RasterizerDensity;
+
+        for (int g = 0; g < src->glyphs.Size; ++g)
+        {
+            const stbtt_packedchar *pc = src->packed_chars + g;
+            stbtt_aligned_quad q;
+            float unused_x = 0.0f;
+            float unused_y = 0.0f;
+            stbtt_GetPackedQuad(src->packed_chars, atlas->TexWidth, atlas->TexHeight, g, &unused_x, &unused_y, &q, 0);
+
+            font->AddGlyph(cfg, (ImWchar)src->glyphs[g],
+                           q.x0 * inv_density + off_x, q.y0 * inv_density + off_y,
+                           q.x1 * inv_density + off_x, q.y1 * inv_density + off_y,
+                           q.s0, q.t0, q.s1, q.t1, pc->xadvance * inv_density);
+        }
+    }
+
+    srcs.clear_destruct();
+    dsts.clear_destruct();
+
+    ImFontAtlasBuildFinish(atlas);
+    _mark_sdf_glyphs(atlas);
+    return true;
+}
+
+static const ImFontBuilderIO _parallel_builder_io = { _build_atlas_parallel };
+
+void imgui_set_font_build_threads(int count)
+{
+    _font_build_threads = count;
+}
+
+static void _reserve_glyph_region(ImFontAtlas *atlas);
+
+bool imgui_build_font_atlas()
+{
+    ImFontAtlas *atlas = ImGui::GetIO().Fonts;
+    _reserve_glyph_region(atlas);
+
+    // same as ImFontAtlas::Build, and the custom rects for cursors and lines
+    // are registered here, so they're part of the key.
+    if (atlas->ConfigData.Size == 0)
+        atlas->AddFontDefault();
+
+#ifndef IMGUI_ENABLE_FREETYPE
+    if (atlas->FontBuilderIO == nullptr)
+        atlas->FontBuilderIO = &_parallel_builder_io;
+#endif
+
+    ImFontAtlasBuildInit(atlas);
+
+    u64 key = _atlas_key(atlas);
+
+    if (_load_atlas_cache(atlas, key))
+    {
+        _mark_sdf_glyphs(atlas);
+        return true;
+    }
+
+    // other builders (FreeType) don't count
+    atlas->Build();
+    _atlas_generation += 1;
+    _write_atlas_cache(atlas, key);
+
+    return false;
+}
+
+/* Dynamic glyphs
+
+A region of IMGUI_GLYPH_REGION_WIDTH x IMGUI_GLYPH_REGION_HEIGHT pixels is
+reserved in the atlas as a custom rect. Requested glyphs are rasterized into
+it with stb_truetype (the same rasterizer the atlas is built with), packed
+into shelves: rows of glyphs that are as high as their highest glyph, a new
+shelf starts when a glyph doesn't fit into the current one. Nothing is ever
+removed, once the region is full no more glyphs are added.
+
+A glyph is taken from the first file of the font (including merged fonts)
+that has it, otherwise from the fallback cache, and added to the font like
+the builder would add it, without oversampling. Glyphs of SDF fonts are
+added as SDF.
+The pixels are written into the atlas (alpha and RGBA, whichever exist), and
+the rectangle containing all glyphs added before a frame is uploaded with
+glTexSubImage2D, the OpenGL3 backend always uses an RGBA texture.
+
+When the atlas is rebuilt (e.g. fonts were added), the glyphs are gone, so
+everything starts over when the atlas pixels change: when the atlas was
+built or loaded again (_atlas_generation), or the pixels moved (rebuilt
+outside of window-base with another builder).
+*/
+#define IMGUI_GLYPH_REGION_WIDTH  512
+#define IMGUI_GLYPH_REGION_HEIGHT 256
+#define IMGUI_GLYPH_PADDING       1
+
+struct imgui_glyph_request
+{
+    ImFont *font;
+    u32 codepoint;
+};
+
+struct imgui_dynamic_glyphs
+{
+    int region;                // custom rect index + 1, 0 = none
+    const void *pixels;        // TexPixelsAlpha8 of the atlas the glyphs are in
+    u64 generation;            // _atlas_generation of the atlas the glyphs are in
+    int shelf_x;               // within the region
+    int shelf_y;
+    int shelf_height;
+    bool full;
+    array<imgui_glyph_request> pending;
+    ImGuiStorage requested;    // hash of font and codepoint -> 1, to request glyphs only once
+    array<ImFont*> changed_fonts;
+    int dirty_x0;              // texture pixels, empty if dirty_x1 <= dirty_x0
+    int dirty_y0;
+    int dirty_x1;
+    int dirty_y1;
+    ff_cache *fallback_cache;
+};
+
+static imgui_dynamic_glyphs _dynamic_glyphs{};
+
+static ImFontAtlasCustomRect *_get_glyph_region(ImFontAtlas *atlas)
+{
+    imgui_dynamic_glyphs *dg = &_dynamic_glyphs;
+
+    if (dg->region <= 0 || dg->region > atlas->CustomRects.Size)
+        return nullptr;
+
+    ImFontAtlasCustomRect *rect = atlas->GetCustomRectByIndex(dg->region - 1);
+
+    if (rect->Width != IMGUI_GLYPH_REGION_WIDTH || rect->Height != IMGUI_GLYPH_REGION_HEIGHT || rect->Font != nullptr)
+        return nullptr;
+
+    return rect;
+}
+
+// custom rects are only removed by ImFontAtlas::Clear, so this usually only
+// adds the region once. it's packed the next time the atlas is built.
+static void _reserve_glyph_region(ImFontAtlas *atlas)
+{
+    if (_get_glyph_region(atlas) == nullptr)
+        _dynamic_glyphs.region = atlas->AddCustomRectRegular(IMGUI_GLYPH_REGION_WIDTH, IMGUI_GLYPH_REGION_HEIGHT) + 1;
+}
+
+static bool _dynamic_glyphs_stale(const ImFontAtlas *atlas)
+{
+    return atlas->TexPixelsAlpha8 != _dynamic_glyphs.pixels
+        || _atlas_generation != _dynamic_glyphs.generation;
+}
+
+static void _reset_dynamic_glyphs(const void *pixels)
+{
+    imgui_dynamic_glyphs *dg = &_dynamic_glyphs;
+    dg->pixels = pixels;
+    dg->generation = _atlas_generation;
+    dg->shelf_x = 0;
+    dg->shelf_y = 0;
+    dg->shelf_height = 0;
+    dg->full = false;
+    dg->pending.size = 0;
+    dg->requested.Clear();
+    dg->dirty_x0 = dg->dirty_y0 = dg->dirty_x1 = dg->dirty_y1 = 0;
+}
+
+void imgui_request_glyphs(const char *text, const char *text_end)
+{
+    imgui_dynamic_glyphs *dg = &_dynamic_glyphs;
+    ImFontAtlas *atlas = ImGui::GetIO().Fonts;
+
+    if (text == nullptr || dg->full || !atlas->IsBuilt() || _dynamic_glyphs_stale(atlas))
+        return;
+
+    ImFont *font = ImGui::GetFont();
+
+    if (text_end == nullptr)
+        text_end = text + string_length(text);
+
+    while (text < text_end)
+    {
+        unsigned int c = 0;
+        text += ImTextCharFromUtf8(&c, text, text_end);
+
+        if (c < 0x20 || c > IM_UNICODE_CODEPOINT_MAX)
+            continue;
+
+        if (font->FindGlyphNoFallback((ImWchar)c) != nullptr)
+            continue;
+
+        ImGuiID key = ImHashData(&c, sizeof(c), ImHashData(&font, sizeof(font)));
+
+        if (dg->requested.GetInt(key) != 0)
+            continue;
+
+        dg->requested.SetInt(key, 1);
+
+        imgui_glyph_request *req = add_at_end(&dg->pending);
+        req->font = font;
+        req->codepoint = c;
+    }
+}
+
+// finds the file of font that has codepoint, and the config to add the glyph with.
+static bool _find_glyph_source(ImFontAtlas *atlas, ImFont *font, u32 codepoint, stbtt_fontinfo *info, int *glyph, const ImFontConfig **cfg)
+{
+    for (int i = 0; i < atlas->ConfigData.Size; ++i)
+    {
+        const ImFontConfig *c = &atlas->ConfigData[i];
+
+        if (c->DstFont != font || !_init_font_info(info, c->FontData, c->FontNo))
+            continue;
+
+        *glyph = stbtt_FindGlyphIndex(info, (int)codepoint);
+
+        if (*glyph != 0)
+        {
+            *cfg = c;
+            return true;
+        }
+    }
+
+    if (_dynamic_glyphs.fallback_cache == nullptr || font->ConfigData == nullptr)
+        return false;
+
+    const char *path = ff_find_font_covering(_dynamic_glyphs.fallback_cache, codepoint, nullptr);
+
+    if (path == nullptr)
+        return false;
+
+    imgui_font_file *file = _get_font_file(path);
+
+    if (file == nullptr || !_init_font_info(info, file->data, 0))
+        return false;
+
+    *glyph = stbtt_FindGlyphIndex(info, (int)codepoint);
+    *cfg = font->ConfigData;
+
+    return *glyph != 0;
+}
+
+// returns false if there's no room left.
+static bool _pack_glyph(const ImFontAtlasCustomRect *region, int w, int h, int *x, int *y)
+{
+    imgui_dynamic_glyphs *dg = &_dynamic_glyphs;
+    int pw = w + IMGUI_GLYPH_PADDING;
+    int ph = h + IMGUI_GLYPH_PADDING;
+
+    if (dg->shelf_x + pw > (int)region->Width)
+    {
+        dg->shelf_y += dg->shelf_height;
+        dg->shelf_x = 0;
+        dg->shelf_height = 0;
+    }
+
+    if (pw > (int)region->Width || dg->shelf_y + ph > (int)region->Height)
+        return false;
+
+    *x = region->X + dg->shelf_x;
+    *y = region->Y + dg->shelf_y;
+    dg->shelf_x += pw;
+
+    if (ph > dg->shelf_height)
+        dg->shelf_height = ph;
+
+    return true;
+}
+
+static void _add_dynamic_glyph(ImFontAtlas *atlas, const ImFontAtlasCustomRect *region, const imgui_glyph_request *req)
+{
+    imgui_dynamic_glyphs *dg = &_dynamic_glyphs;
+    stbtt_fontinfo info;
+    int glyph = 0;
+    const ImFontConfig *cfg = nullptr;
+
+    if (!_find_glyph_source(atlas, req->font, req->codepoint, &info, &glyph, &cfg))
+        return;
+
+    float scale = cfg->SizePixels > 0 ? stbtt_ScaleForPixelHeight(&info, cfg->SizePixels)
+                                      : stbtt_ScaleForMappingEmToPixels(&info, -cfg->SizePixels);
+
+    bool sdf = _is_sdf_font(req->font);
+    unsigned char *sdf_bitmap = nullptr;
+    int x0, y0, x1, y1;
+
+    if (sdf)
+    {
+        int sw = 0;
+        int sh = 0;
+        x0 = y0 = 0;
+        sdf_bitmap = stbtt_GetGlyphSDF(&info, scale, glyph, IMGUI_SDF_PADDING, IMGUI_SDF_ON_EDGE,
+                                       (float)IMGUI_SDF_ON_EDGE / IMGUI_SDF_PADDING, &sw, &sh, &x0, &y0);
+        x1 = x0 + sw;
+        y1 = y0 + sh;
+    }
+    else
+        stbtt_GetGlyphBitmapBox(&info, glyph, scale, scale, &x0, &y0, &x1, &y1);
+
+    defer { if (sdf_bitmap != nullptr) stbtt_FreeSDF(sdf_bitmap, nullptr); };
+
+    int w = x1 - x0;
+    int h = y1 - y0;
+    int x = 0;
+    int y = 0;
+
+    if (w > 0 && h > 0)
+    {
+        if (!_pack_glyph(region, w, h, &x, &y))
+        {
+            dg->full = true;
+            return;
+        }
+
+        int stride = atlas->TexWidth;
+        unsigned char *alpha = atlas->TexPixelsAlpha8 + (s64)y * stride + x;
+
+        if (sdf)
+        {
+            for (int row = 0; row < h; ++row)
+                copy_memory(sdf_bitmap + (s64)row * w, alpha + (s64)row * stride, w);
+        }
+        else
+            stbtt_MakeGlyphBitmap(&info, alpha, w, h, stride, scale, scale, glyph);
+
+        if (!sdf && cfg->RasterizerMultiply != 1.0f)
+        {
+            unsigned char table[256];
+            ImFontAtlasBuildMultiplyCalcLookupTable(table, cfg->RasterizerMultiply);
+            ImFontAtlasBuildMultiplyRectAlpha8(table, atlas->TexPixelsAlpha8, x, y, w, h, stride);
+        }
+
+        if (atlas->TexPixelsRGBA32 != nullptr)
+        {
+            // see SDF fonts
+            unsigned char c = sdf ? 0 : 255;
+
+            for (int row = 0; row < h; ++row)
+            {
+                const unsigned char *src = alpha + (s64)row * stride;
+                unsigned int *dst = atlas->TexPixelsRGBA32 + (s64)(y + row) * stride + x;
+
+                for (int col = 0; col < w; ++col)
+                    dst[col] = IM_COL32(c, c, c, src[col]);
+            }
+        }
+
+        if (dg->dirty_x1 <= dg->dirty_x0)
+        {
+            dg->dirty_x0 = x;
+            dg->dirty_y0 = y;
+            dg->dirty_x1 = x + w;
+            dg->dirty_y1 = y + h;
+        }
+        else
+        {
+            dg->dirty_x0 = ImMin(dg->dirty_x0, x);
+            dg->dirty_y0 = ImMin(dg->dirty_y0, y);
+            dg->dirty_x1 = ImMax(dg->dirty_x1, x + w);
+            dg->dirty_y1 = ImMax(dg->dirty_y1, y + h);
+        }
+    }
+
+    int advance = 0;
+    int lsb = 0;
+    stbtt_GetGlyphHMetrics(&info, glyph, &advance, &lsb);
+
+    // same placement as the builder
+    float off_x = cfg->GlyphOffset.x;
+    float off_y = cfg->GlyphOffset.y + IM_ROUND(req->font->Ascent);
+
+    req->font->AddGlyph(cfg, (ImWchar)req->codepoint,
+                        x0 + off_x, y0 + off_y, x1 + off_x, y1 + off_y,
+                        x * atlas->TexUvScale.x, y * atlas->TexUvScale.y,
+                        (x + w) * atlas->TexUvScale.x, (y + h) * atlas->TexUvScale.y,
+                        advance * scale);
+
+    for_array(font, &dg->changed_fonts)
+        if (*font == req->font)
+            return;
+
+    *add_at_end(&dg->changed_fonts) = req->font;
+}
+
+static void _upload_dirty_rect(ImFontAtlas *atlas)
+{
+    imgui_dynamic_glyphs *dg = &_dynamic_glyphs;
+    GLuint texture = (GLuint)(intptr_t)atlas->TexID;
+
+    // without a texture or RGBA pixels, the backend uploads everything
+    // when it creates the texture.
+    if (texture == 0 || atlas->TexPixelsRGBA32 == nullptr || dg->dirty_x1 <= dg->dirty_x0)
+        return;
+
+    GLint last_texture;
+    GLint last_row_length;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
+    glGetIntegerv(GL_UNPACK_ROW_LENGTH, &last_row_length);
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, atlas->TexWidth);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, dg->dirty_x0, dg->dirty_y0,
+                    dg->dirty_x1 - dg->dirty_x0, dg->dirty_y1 - dg->dirty_y0,
+                    GL_RGBA, GL_UNSIGNED_BYTE,
+                    atlas->TexPixelsRGBA32 + (s64)dg->dirty_y0 * atlas->TexWidth + dg->dirty_x0);
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, last_row_length);
+    glBindTexture(GL_TEXTURE_2D, (GLuint)last_texture);
+
+    dg->dirty_x0 = dg->dirty_y0 = dg->dirty_x1 = dg->dirty_y1 = 0;
+}
+
+void imgui_update_dynamic_glyphs()
+{
+    imgui_dynamic_glyphs *dg = &_dynamic_glyphs;
+    ImFontAtlas *atlas = ImGui::GetIO().Fonts;
+
+    _reserve_glyph_region(atlas);
+
+    if (!atlas->IsBuilt() || atlas->TexPixelsAlpha8 == nullptr)
+        return;
+
+    if (_dynamic_glyphs_stale(atlas))
+        _reset_dynamic_glyphs(atlas->TexPixelsAlpha8);
+
+    const ImFontAtlasCustomRect *region = _get_glyph_region(atlas);
+
+    // the atlas was built before the region was reserved
+    if (region == nullptr || !region->IsPacked())
+    {
+        dg->full = true;
+        return;
+    }
+
+    for_array(req, &dg->pending)
+    {
+        if (dg->full)
+            break;
+
+        _add_dynamic_glyph(atlas, region, req);
+    }
+
+    dg->pending.size = 0;
+
+    for_array(font, &dg->changed_fonts)
+        (*font)->BuildLookupTable();
+
+    dg->changed_fonts.size = 0;
+
+    _upload_dirty_rect(atlas);
+}
+
+/* SDF shader
+
+The OpenGL3 backend draws everything with one program, so imgui_use_sdf_shader
+inserts draw callbacks into the draw lists: before the first command that
+uses the font atlas texture, one that switches to the SDF program, and before
+the next command that doesn't, one that switches back to the program of the
+backend. Other textures (images, ...) never see the SDF program.
+
+The SDF program is the program of the backend with a different fragment
+shader: texels of SDF glyphs (black, see SDF fonts) are turned into coverage
+with a smoothstep one screen pixel wide around the outline, other texels are
+used as they are, so everything else looks the same. Its attribute locations
+are bound to those of the backend program, since it draws with the vertex
+array of the backend, and the projection is copied from the backend program
+every time it's switched to.
+Every ImGui context has a backend with a program of its own (one per window),
+so there's one SDF program per backend program, linked the first time it's
+needed. Render threads of different windows may do that at the same time,
+the programs are behind a lock, and the program to switch back to is per
+thread.
+GL 2.0 functions are not exported on every platform, they're loaded through
+GLFW.
+*/
+#ifndef GL_FRAGMENT_SHADER
+#define GL_FRAGMENT_SHADER 0x8B30
+#endif
+#ifndef GL_VERTEX_SHADER
+#define GL_VERTEX_SHADER   0x8B31
+#endif
+#ifndef GL_COMPILE_STATUS
+#define GL_COMPILE_STATUS  0x8B81
+#endif
+#ifndef GL_LINK_STATUS
+#define GL_LINK_STATUS     0x8B82
+#endif
+#ifndef GL_CURRENT_PROGRAM
+#define GL_CURRENT_PROGRAM 0x8B8D
+#endif
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#define IMGUI_SDF_MAX_PROGRAMS 16
+
+struct imgui_sdf_program
+{
+    GLuint program;
+    GLuint backend_program;  // the program was linked against
+    GLint proj_mtx;
+    GLint backend_proj_mtx;
+};
+
+struct imgui_sdf_shader
+{
+    bool loaded;
+    bool failed;             // no GL functions or the shaders don't compile
+    imgui_sdf_program programs[IMGUI_SDF_MAX_PROGRAMS];
+    int program_count;
+
+    GLuint (APIENTRY *CreateShader)(GLenum type);
+    void   (APIENTRY *ShaderSource)(GLuint shader, GLsizei count, const char *const *strings, const GLint *lengths);
+    void   (APIENTRY *CompileShader)(GLuint shader);
+    void   (APIENTRY *GetShaderiv)(GLuint shader, GLenum name, GLint *out);
+    void   (APIENTRY *DeleteShader)(GLuint shader);
+    GLuint (APIENTRY *CreateProgram)();
+    void   (APIENTRY *AttachShader)(GLuint program, GLuint shader);
+    void   (APIENTRY *BindAttribLocation)(GLuint program, GLuint index, const char *name);
+    void   (APIENTRY *LinkProgram)(GLuint program);
+    void   (APIENTRY *GetProgramiv)(GLuint program, GLenum name, GLint *out);
+    void   (APIENTRY *DeleteProgram)(GLuint program);
+    void   (APIENTRY *UseProgram)(GLuint program);
+    GLint  (APIENTRY *GetAttribLocation)(GLuint program, const char *name);
+    GLint  (APIENTRY *GetUniformLocation)(GLuint program, const char *name);
+    void   (APIENTRY *GetUniformfv)(GLuint program, GLint location, GLfloat *out);
+    void   (APIENTRY *Uniform1i)(GLint location, GLint value);
+    void   (APIENTRY *UniformMatrix4fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+};
+
+static imgui_sdf_shader _sdf_shader{};
+
+#if Windows
+static SRWLOCK _sdf_programs_lock = SRWLOCK_INIT;
+#elif Linux
+static pthread_mutex_t _sdf_programs_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+// the backend program _end_sdf_shader switches back to
+static thread_local GLuint _sdf_backend_program = 0;
+
+static const char *_sdf_vertex_shader =
+    "#version 330\n"
+    "uniform mat4 ProjMtx;\n"
+    "in vec2 Position;\n"
+    "in vec2 UV;\n"
+    "in vec4 Color;\n"
+    "out vec2 Frag_UV;\n"
+    "out vec4 Frag_Color;\n"
+    "void main()\n"
+    "{\n"
+    "    Frag_UV = UV;\n"
+    "    Frag_Color = Color;\n"
+    "    gl_Position = ProjMtx * vec4(Position.xy, 0, 1);\n"
+    "}\n";
+
+static const char *_sdf_fragment_shader =
+    "#version 330\n"
+    "uniform sampler2D Texture;\n"
+    "in vec2 Frag_UV;\n"
+    "in vec4 Frag_Color;\n"
+    "layout (location = 0) out vec4 Out_Color;\n"
+    "void main()\n"
+    "{\n"
+    "    vec4 tex = texture(Texture, Frag_UV.st);\n"
+    "    float sdf = 1.0 - tex.r;\n" // 1 for SDF glyph texels, 0 for others
+    "    float w = 0.5 * fwidth(tex.a);\n"
+    "    float coverage = smoothstep(0.5 - w, 0.5 + w, tex.a);\n"
+    "    Out_Color = Frag_Color * vec4(mix(tex.rgb, vec3(1.0), sdf), mix(tex.a, coverage, sdf));\n"
+    "}\n";
+
+#define _load_gl_function(S, Name) \
+    (*(GLFWglproc*)&(S)->Name = glfwGetProcAddress("gl" #Name), (S)->Name != nullptr)
+
+static bool _load_sdf_gl_functions(imgui_sdf_shader *s)
+{
+    return _load_gl_function(s, CreateShader)
+        && _load_gl_function(s, ShaderSource)
+        && _load_gl_function(s, CompileShader)
+        && _load_gl_function(s, GetShaderiv)
+        && _load_gl_function(s, DeleteShader)
+        && _load_gl_function(s, CreateProgram)
+        && _load_gl_function(s, AttachShader)
+        && _load_gl_function(s, BindAttribLocation)
+        && _load_gl_function(s, LinkProgram)
+        && _load_gl_function(s, GetProgramiv)
+        && _load_gl_function(s, DeleteProgram)
+        && _load_gl_function(s, UseProgram)
+        && _load_gl_function(s, GetAttribLocation)
+        && _load_gl_function(s, GetUniformLocation)
+        && _load_gl_function(s, GetUniformfv)
+        && _load_gl_function(s, Uniform1i)
+        && _load_gl_function(s, UniformMatrix4fv);
+}
+
+static GLuint _compile_sdf_shader(imgui_sdf_shader *s, GLenum type, const char *source)
+{
+    GLuint shader = s->CreateShader(type);
+    s->ShaderSource(shader, 1, &source, nullptr);
+    s->CompileShader(shader);
+
+    GLint status = 0;
+    s->GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+
+    if (status == 0)
+    {
+        s->DeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+static bool _link_sdf_program(imgui_sdf_shader *s, GLuint backend_program, imgui_sdf_program *out)
+{
+    GLuint vs = _compile_sdf_shader(s, GL_VERTEX_SHADER, _sdf_vertex_shader);
+    GLuint fs = _compile_sdf_shader(s, GL_FRAGMENT_SHADER, _sdf_fragment_shader);
+
+    defer
+    {
+        if (vs != 0) s->DeleteShader(vs);
+        if (fs != 0) s->DeleteShader(fs);
+    };
+
+    if (vs == 0 || fs == 0)
+        return false;
+
+    GLuint program = s->CreateProgram();
+    s->AttachShader(program, vs);
+    s->AttachShader(program, fs);
+
+    const char *attributes[] = {"Position", "UV", "Color"};
+
+    for (const char *attribute : attributes)
+    {
+        GLint location = s->GetAttribLocation(backend_program, attribute);
+
+        if (location >= 0)
+            s->BindAttribLocation(program, (GLuint)location, attribute);
+    }
+
+    s->LinkProgram(program);
+
+    GLint status = 0;
+    s->GetProgramiv(program, GL_LINK_STATUS, &status);
+
+    if (status == 0)
+    {
+        s->DeleteProgram(program);
+        return false;
+    }
+
+    out->program = program;
+    out->backend_program = backend_program;
+    out->proj_mtx = s->GetUniformLocation(program, "ProjMtx");
+    out->backend_proj_mtx = s->GetUniformLocation(backend_program, "ProjMtx");
+
+    s->UseProgram(program);
+    s->Uniform1i(s->GetUniformLocation(program, "Texture"), 0);
+    s->UseProgram(backend_program);
+
+    return true;
+}
+
+// the SDF program for backend_program, linked if there is none yet.
+// nullptr if it can't be linked or there are too many.
+static imgui_sdf_program *_get_sdf_program(imgui_sdf_shader *s, GLuint backend_program)
+{
+#if Windows
+    AcquireSRWLockExclusive(&_sdf_programs_lock);
+    defer { ReleaseSRWLockExclusive(&_sdf_programs_lock); };
+#elif Linux
+    pthread_mutex_lock(&_sdf_programs_lock);
+    defer { pthread_mutex_unlock(&_sdf_programs_lock); };
+#endif
+
+    for (int i = 0; i < s->program_count; ++i)
+        if (s->programs[i].backend_program == backend_program)
+            return s->programs + i;
+
+    if (s->failed || s->program_count >= IMGUI_SDF_MAX_PROGRAMS)
+        return nullptr;
+
+    imgui_sdf_program *ret = s->programs + s->program_count;
+
+    if (!_link_sdf_program(s, backend_program, ret))
+    {
+        s->failed = true;
+        return nullptr;
+    }
+
+    s->program_count += 1;
+    return ret;
+}
+
+static bool _is_sdf_program(imgui_sdf_shader *s, GLuint program)
+{
+    if (program == 0)
+        return false;
+
+#if Windows
+    AcquireSRWLockExclusive(&_sdf_programs_lock);
+    defer { ReleaseSRWLockExclusive(&_sdf_programs_lock); };
+#elif Linux
+    pthread_mutex_lock(&_sdf_programs_lock);
+    defer { pthread_mutex_unlock(&_sdf_programs_lock); };
+#endif
+
+    for (int i = 0; i < s->program_count; ++i)
+        if (s->programs[i].program == program)
+            return true;
+
+    return false;
+}
+
+static void _begin_sdf_shader(const ImDrawList *list, const ImDrawCmd *cmd)
+{
+    (void)list;
+    (void)cmd;
+    imgui_sdf_shader *s = &_sdf_shader;
+
+    if (s->failed)
+        return;
+
+    GLint current = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+
+    if (_is_sdf_program(s, (GLuint)current))
+        return;
+
+    imgui_sdf_program *sdf = _get_sdf_program(s, (GLuint)current);
+
+    if (sdf == nullptr)
+        return;
+
+    _sdf_backend_program = (GLuint)current;
+
+    GLfloat proj[16];
+    s->GetUniformfv(sdf->backend_program, sdf->backend_proj_mtx, proj);
+    s->UseProgram(sdf->program);
+    s->UniformMatrix4fv(sdf->proj_mtx, 1, GL_FALSE, proj);
+}
+
+static void _end_sdf_shader(const ImDrawList *list, const ImDrawCmd *cmd)
+{
+    (void)list;
+    (void)cmd;
+    imgui_sdf_shader *s = &_sdf_shader;
+
+    if (_sdf_backend_program != 0)
+        s->UseProgram(_sdf_backend_program);
+
+    _sdf_backend_program = 0;
+}
+
+static void _add_callback(ImVector<ImDrawCmd> *cmds, ImDrawCallback callback)
+{
+    ImDrawCmd cmd;
+    cmd.UserCallback = callback;
+    cmds->push_back(cmd);
+}
+
+static void _insert_sdf_callbacks(ImDrawList *list, ImTextureID atlas_texture)
+{
+    ImVector<ImDrawCmd> cmds;
+    cmds.reserve(list->CmdBuffer.Size + 2);
+    bool active = false; // SDF program in use
+
+    for (int i = 0; i < list->CmdBuffer.Size; ++i)
+    {
+        const ImDrawCmd *cmd = &list->CmdBuffer[i];
+
+        if (cmd->UserCallback != nullptr)
+        {
+            // user callbacks get the backend program
+            if (active)
+                _add_callback(&cmds, _end_sdf_shader);
+
+            active = false;
+        }
+        else
+        {
+            bool sdf = cmd->GetTexID() == atlas_texture;
+
+            if (sdf != active)
+                _add_callback(&cmds, sdf ? _begin_sdf_shader : _end_sdf_shader);
+
+            active = sdf;
+        }
+
+        cmds.push_back(*cmd);
+    }
+
+    // every list starts with the backend program
+    if (active)
+        _add_callback(&cmds, _end_sdf_shader);
+
+    list->CmdBuffer.swap(cmds);
+}
+
+void imgui_use_sdf_shader(ImDrawData *draw_data)
+{
+    imgui_sdf_shader *s = &_sdf_shader;
+
+    if (_sdf_fonts.size == 0 || draw_data == nullptr || s->failed)
+        return;
+
+    if (!s->loaded)
+    {
+        s->loaded = true;
+
+        if (!_load_sdf_gl_functions(s))
+        {
+            s->failed = true;
+            return;
+        }
+    }
+
+    ImTextureID atlas_texture = ImGui::GetIO().Fonts->TexID;
+
+    for (int i = 0; i < draw_data->CmdListsCount; ++i)
+        _insert_sdf_callbacks(draw_data->CmdLists[i], atlas_texture);
+}
+
+void imgui_set_glyph_fallback_cache(ff_cache *cache)
+{
+    _dynamic_glyphs.fallback_cache = cache;
+}
+
+void imgui_fonts_exit()
+{
+    imgui_dynamic_glyphs *dg = &_dynamic_glyphs;
+    free(&dg->pending);
+    free(&dg->changed_fonts);
+    dg->requested.Clear();
+    *dg = {};
+
+    imgui_sdf_shader *s = &_sdf_shader;
+
+    // programs are shared by all contexts of the windows
+    if (glfwGetCurrentContext() != nullptr)
+        for (int i = 0; i < s->program_count; ++i)
+            s->DeleteProgram(s->programs[i].program);
+
+    *s = {};
+    free(&_sdf_fonts);
+
+    for_array(file, &_font_files)
+        _unmap_font_file(file);
+
+    free(&_font_files);
+}
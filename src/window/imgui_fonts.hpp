@@ -0,0 +1,69 @@
+#pragma once
+
+// imgui_fonts.hpp
+// Adding fonts from files to the ImGui font atlas without copying them,
+// SDF fonts, caching built atlases and adding missing glyphs on demand.
+
+#include "imgui.h"
+
+struct ff_cache;
+
+// Like ImFontAtlas::AddFontFromFileTTF, but the file is mapped into memory
+// once and the mapping is shared by every font added from the same path
+// (other sizes, merged fonts, ...), the atlas never copies or owns the data.
+// config->FontDataOwnedByAtlas is ignored.
+// Returns nullptr if the file could not be mapped.
+ImFont *imgui_add_font_from_file(const char *path, float size_pixels, const ImFontConfig *config = nullptr, const ImWchar *glyph_ranges = nullptr);
+
+// Like imgui_add_font_from_file, but the glyphs are stored as signed distance
+// fields, which stay sharp at any scale, so one atlas serves every DPI and
+// zoom level: draw the font scaled (io.FontGlobalScale,
+// ImGui::SetWindowFontScale, ...) instead of adding it again at another size.
+// Add it at the largest size it's usually drawn at.
+// Fonts merged into an SDF font are SDF as well.
+// Only with the builder of imgui_build_font_atlas, and the draw data has to be
+// passed to imgui_use_sdf_shader before rendering.
+ImFont *imgui_add_sdf_font_from_file(const char *path, float size_pixels, const ImFontConfig *config = nullptr, const ImWchar *glyph_ranges = nullptr);
+bool imgui_is_sdf_font(const ImFont *font);
+
+// Inserts callbacks into the draw lists that draw the font atlas with a shader
+// for SDF fonts (OpenGL3 backend). Does nothing if there are no SDF fonts.
+// Call between ImGui::Render and ImGui_ImplOpenGL3_RenderDrawData,
+// default_render_function does.
+void imgui_use_sdf_shader(ImDrawData *draw_data);
+
+// Builds the font atlas after all fonts were added, or loads it from the
+// on-disk cache if the same fonts (same files, sizes, glyph ranges, ...) were
+// built before, which skips rasterizing entirely.
+// Call before the renderer backend creates the font texture, e.g. before the
+// first frame or before recreating the texture after changing fonts.
+// Returns true if the atlas was loaded from the cache.
+bool imgui_build_font_atlas();
+
+// The atlas is built with a builder that rasterizes the glyphs of all fonts
+// on count threads, 0 (default) = one per core. The atlas is identical for
+// any count, 1 builds it on the calling thread only.
+// Not used if the atlas has a builder already (e.g. FreeType).
+void imgui_set_font_build_threads(int count);
+
+// Dynamic glyphs: glyphs that are not in the glyph ranges a font was added
+// with are rasterized on demand into a region reserved in the atlas, and only
+// the changed part of the font texture is uploaded again (OpenGL3 backend).
+// ImGui can't tell when a glyph is missing, so text that may contain
+// characters outside the loaded ranges (file names, user input, ...) has to
+// be passed to imgui_request_glyphs while the font it's drawn with is pushed.
+// Requested glyphs are added by imgui_update_dynamic_glyphs, which
+// imgui_new_frame calls before the frame starts. Until then, and if the
+// region is full, the fallback glyph is drawn.
+void imgui_request_glyphs(const char *text, const char *text_end = nullptr);
+void imgui_update_dynamic_glyphs();
+
+// Glyphs that are not in any file of a font are taken from the font file
+// ff_find_font_covering finds in cache, if it's set (nullptr to unset).
+// The cache must stay loaded until it's unset or imgui_exit.
+void imgui_set_glyph_fallback_cache(ff_cache *cache);
+
+// Unmaps all font files and frees the dynamic glyphs. The font atlas must not
+// be built again afterwards, imgui_exit calls this after destroying the
+// ImGui context.
+void imgui_fonts_exit();
@@ -3,6 +3,18 @@
 #include "imgui_internal.h"
 #include "shl/print.hpp"
 #include "shl/time.hpp"
+#include "shl/array.hpp"
+#include "shl/memory.hpp"
+#include "shl/sort.hpp"
+#include "shl/defer.hpp"
+#include "shl/platform.hpp"
+
+#if Windows
+#include <windows.h>
+#elif Linux
+#include <pthread.h>
+#include <time.h>
+#endif
 
 #include "GLFW/glfw3.h"
 
@@ -12,9 +24,309 @@
 #include "ui/filepicker.hpp"
 #include "ui/colorscheme.hpp"
 #include "window/window_imgui_util.hpp"
+#include "window/imgui_fonts.hpp"
 
 static const char *_glsl_version = "#version 330";
 
+#define WINDOW_GPU_QUERY_COUNT 4
+
+struct window_render_pipeline;
+
+// the callbacks the ImGui GLFW backend installed, see Multiple windows
+struct window_imgui_callbacks
+{
+    GLFWwindowfocusfun window_focus;
+    GLFWcursorenterfun cursor_enter;
+    GLFWcursorposfun cursor_pos;
+    GLFWmousebuttonfun mouse_button;
+    GLFWscrollfun scroll;
+    GLFWkeyfun key;
+    GLFWcharfun character;
+};
+
+/* Window state
+
+State the event loop keeps per window, in a small array since there's only a
+handful of windows. The GLFW user pointer is left to the application.
+States are allocated one by one, the render thread of a pipelined loop keeps
+a pointer to its window's state while the array may grow.
+*/
+struct window_state
+{
+    GLFWwindow *window;
+    int redraw_frames;          // frames the idle loop runs without waiting
+    bool refreshed;             // refreshed since the idle loop last checked
+    bool damaged;               // refreshed since the last frame was drawn
+    int framebuffer_width;
+    int framebuffer_height;
+    GLFWwindowrefreshfun previous_refresh_callback;
+
+    // skip_unchanged_render_function
+    bool presented;             // draw_hash is valid
+    u64 draw_hash;
+    timespan interval_start;    // the last presented frame, or a skipped one at least an interval later
+    double interval;            // refresh interval at the last skipped frame
+    bool skip_wait;             // the last frame was skipped, see _skipped_frame_wait
+    s64 skipped_frames;
+
+    // see Frame stats
+    window_frame_timing frames[WINDOW_FRAME_STATS_COUNT];
+    s64 frame_count;            // frames[frame_count % WINDOW_FRAME_STATS_COUNT] is the current frame
+    bool gpu_queries_failed;
+    GLuint gpu_queries[WINDOW_GPU_QUERY_COUNT];
+    s64 gpu_query_frames[WINDOW_GPU_QUERY_COUNT]; // frame + 1 a query is pending for, 0 = none
+
+    window_render_pipeline *pipeline; // while a pipelined loop runs
+
+    // imgui_init
+    ImGuiContext *imgui_context;
+    window_imgui_callbacks imgui_callbacks;
+};
+
+// a frame of a pipelined loop, see Pipelined rendering
+struct window_draw_snapshot
+{
+    ImDrawData draw_data;           // CmdLists point to lists
+    ImVector<ImDrawList*> lists;    // copies of the lists, reused every frame
+    window_state *state;
+    double dt;
+    s64 frame;                      // index in the frame stats
+    int framebuffer_width;
+    int framebuffer_height;
+    double refresh_interval;
+    bool damaged;
+    bool has_callbacks;             // user callbacks, before the SDF callbacks were inserted
+    void *fence;                    // GLsync of the UI thread's GL commands, may be nullptr
+};
+
+static array<window_state*> _window_states{};
+
+// the snapshot the render thread of a pipelined loop is rendering, nullptr
+// on every other thread.
+static thread_local window_draw_snapshot *_pipeline_snapshot = nullptr;
+
+static void _window_refresh_callback(GLFWwindow *window);
+
+static window_state *_get_window_state(GLFWwindow *window)
+{
+    // the render thread must not touch the array
+    if (_pipeline_snapshot != nullptr && _pipeline_snapshot->state->window == window)
+        return _pipeline_snapshot->state;
+
+    for_array(ws, &_window_states)
+        if ((*ws)->window == window)
+            return *ws;
+
+    window_state *ret = alloc<window_state>();
+    fill_memory(ret, 0);
+    ret->window = window;
+    ret->previous_refresh_callback = glfwSetWindowRefreshCallback(window, _window_refresh_callback);
+    add_at_end(&_window_states, ret);
+    return ret;
+}
+
+static void _window_refresh_callback(GLFWwindow *window)
+{
+    window_state *ws = _get_window_state(window);
+    ws->refreshed = true;
+    ws->damaged = true;
+
+    if (ws->previous_refresh_callback != nullptr)
+        ws->previous_refresh_callback(window);
+}
+
+// on the render thread of a pipelined loop, the frame it's rendering
+static inline s64 _current_frame_index(window_state *ws)
+{
+    if (_pipeline_snapshot != nullptr)
+        return _pipeline_snapshot->frame;
+
+    return ws->frame_count;
+}
+
+static inline window_frame_timing *_current_frame(window_state *ws)
+{
+    return ws->frames + (_current_frame_index(ws) % WINDOW_FRAME_STATS_COUNT);
+}
+
+static void _pipeline_lock(window_render_pipeline *p);
+static void _pipeline_unlock(window_render_pipeline *p);
+
+// the render thread of a pipelined loop writes the timings of the frames it
+// renders while the UI thread may copy them (window_get_frame_stats), both
+// do so holding the lock of the pipeline.
+static void _lock_frame_stats(window_state *ws)
+{
+    if (ws->pipeline != nullptr)
+        _pipeline_lock(ws->pipeline);
+}
+
+static void _unlock_frame_stats(window_state *ws)
+{
+    if (ws->pipeline != nullptr)
+        _pipeline_unlock(ws->pipeline);
+}
+
+static void _get_framebuffer_size(GLFWwindow *window, int *width, int *height)
+{
+    // main thread only in GLFW
+    if (_pipeline_snapshot != nullptr)
+    {
+        *width = _pipeline_snapshot->framebuffer_width;
+        *height = _pipeline_snapshot->framebuffer_height;
+        return;
+    }
+
+    glfwGetFramebufferSize(window, width, height);
+}
+
+static double _seconds_since(const timespan *start)
+{
+    timespan now;
+    get_time(&now);
+    return get_seconds_difference(start, &now);
+}
+
+/* GPU timer queries
+
+Every drawn frame is timed with a GL_TIME_ELAPSED query. Results are read
+WINDOW_GPU_QUERY_COUNT frames later at the latest, when the query is reused,
+by then the GPU is done with the frame so reading doesn't stall. Earlier if
+they're available when the next frame begins. Results of frames that are not
+in the stats anymore are dropped.
+The query functions are GL 3.3 and loaded through GLFW. If they're missing
+or the context can't create queries, gpu_seconds stays -1.
+*/
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED           0x88BF
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT           0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+struct window_gpu_query_functions
+{
+    bool loaded;
+    bool available;
+    void (APIENTRY *GenQueries)(GLsizei n, GLuint *ids);
+    void (APIENTRY *DeleteQueries)(GLsizei n, const GLuint *ids);
+    void (APIENTRY *BeginQuery)(GLenum target, GLuint id);
+    void (APIENTRY *EndQuery)(GLenum target);
+    void (APIENTRY *GetQueryObjectiv)(GLuint id, GLenum name, GLint *out);
+    void (APIENTRY *GetQueryObjectui64v)(GLuint id, GLenum name, unsigned long long *out);
+};
+
+static window_gpu_query_functions _gpu_query_functions{};
+
+#define _load_gl_function(F, Name) \
+    (*(GLFWglproc*)&(F)->Name = glfwGetProcAddress("gl" #Name), (F)->Name != nullptr)
+
+static window_gpu_query_functions *_get_gpu_query_functions()
+{
+    window_gpu_query_functions *f = &_gpu_query_functions;
+
+    if (!f->loaded)
+    {
+        f->loaded = true;
+        f->available = _load_gl_function(f, GenQueries)
+                    && _load_gl_function(f, DeleteQueries)
+                    && _load_gl_function(f, BeginQuery)
+                    && _load_gl_function(f, EndQuery)
+                    && _load_gl_function(f, GetQueryObjectiv)
+                    && _load_gl_function(f, GetQueryObjectui64v);
+    }
+
+    return f->available ? f : nullptr;
+}
+
+static void _read_gpu_query(window_state *ws, int i, bool wait)
+{
+    window_gpu_query_functions *f = _get_gpu_query_functions();
+    s64 frame = ws->gpu_query_frames[i] - 1;
+
+    if (f == nullptr || frame < 0)
+        return;
+
+    if (!wait)
+    {
+        GLint available = 0;
+        f->GetQueryObjectiv(ws->gpu_queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+
+        if (available == 0)
+            return;
+    }
+
+    unsigned long long ns = 0;
+    f->GetQueryObjectui64v(ws->gpu_queries[i], GL_QUERY_RESULT, &ns);
+    ws->gpu_query_frames[i] = 0;
+
+    // the UI thread is ahead of the render thread, its frame_count isn't
+    // the frame being rendered.
+    if (_current_frame_index(ws) - frame >= WINDOW_FRAME_STATS_COUNT)
+        return;
+
+    _lock_frame_stats(ws);
+    ws->frames[frame % WINDOW_FRAME_STATS_COUNT].gpu_seconds = (double)ns / 1000000000.0;
+    _unlock_frame_stats(ws);
+}
+
+static void _read_available_gpu_queries(window_state *ws)
+{
+    for (int i = 0; i < WINDOW_GPU_QUERY_COUNT; ++i)
+        _read_gpu_query(ws, i, false);
+}
+
+static bool _begin_gpu_query(window_state *ws)
+{
+    window_gpu_query_functions *f = _get_gpu_query_functions();
+
+    if (f == nullptr || ws->gpu_queries_failed)
+        return false;
+
+    if (ws->gpu_queries[0] == 0)
+    {
+        f->GenQueries(WINDOW_GPU_QUERY_COUNT, ws->gpu_queries);
+
+        if (ws->gpu_queries[0] == 0)
+        {
+            ws->gpu_queries_failed = true;
+            return false;
+        }
+    }
+
+    s64 frame = _current_frame_index(ws);
+    int i = (int)(frame % WINDOW_GPU_QUERY_COUNT);
+    _read_gpu_query(ws, i, true);
+
+    f->BeginQuery(GL_TIME_ELAPSED, ws->gpu_queries[i]);
+    ws->gpu_query_frames[i] = frame + 1;
+    return true;
+}
+
+static void _end_gpu_query()
+{
+    _get_gpu_query_functions()->EndQuery(GL_TIME_ELAPSED);
+}
+
+static void _free_gpu_queries(window_state *ws)
+{
+    window_gpu_query_functions *f = _get_gpu_query_functions();
+
+    // needs the context of the window
+    if (f != nullptr && ws->gpu_queries[0] != 0 && glfwGetCurrentContext() == ws->window)
+        f->DeleteQueries(WINDOW_GPU_QUERY_COUNT, ws->gpu_queries);
+
+    fill_memory(ws->gpu_queries, 0, sizeof(ws->gpu_queries));
+}
+
+static void _begin_frame(window_state *ws);
+
 static void _glfw_error_callback(int error, const char *description)
 {
     tprint(stderr_handle(), "GLFW Error %d: %s\n", error, description);
@@ -36,18 +348,28 @@ void window_init()
 
 void window_exit()
 {
+    for_array(ws, &_window_states)
+    {
+        _free_gpu_queries(*ws);
+        dealloc(*ws);
+    }
+
     glfwTerminate();
+    free(&_window_states);
 }
 
 GLFWwindow *window_create(const char *title, int width, int height)
 {
-    GLFWwindow *ret = glfwCreateWindow(width, height, title, nullptr, nullptr);
+    // all windows share GL objects, see Multiple windows
+    GLFWwindow *share = _window_states.size > 0 ? _window_states[0]->window : nullptr;
+    GLFWwindow *ret = glfwCreateWindow(width, height, title, nullptr, share);
 
     if (ret == nullptr)
         return nullptr;
 
     glfwMakeContextCurrent(ret);
     glfwSwapInterval(1);
+    _get_window_state(ret);
 
     return ret;
 }
@@ -59,6 +381,15 @@ void window_close(GLFWwindow *window)
 
 void window_destroy(GLFWwindow *window)
 {
+    for (s64 i = 0; i < _window_states.size; ++i)
+        if (_window_states[i]->window == window)
+        {
+            _free_gpu_queries(_window_states[i]);
+            dealloc(_window_states[i]);
+            remove_elements(&_window_states, i, 1);
+            break;
+        }
+
     glfwDestroyWindow(window);
 }
 
@@ -111,117 +442,1395 @@ void window_set_keyboard_callback(GLFWwindow *window, keyboard_callback cb)
     glfwSetKeyCallback(window, cb);
 }
 
-void default_render_function(GLFWwindow *window, double dt)
+static void _present_draw_data(GLFWwindow *window, ImDrawData *draw_data)
 {
-    (void)dt;
-    ImGui::Render();
+    window_state *ws = _get_window_state(window);
+    timespan start;
+    get_time(&start);
+
+    bool gpu_query = _begin_gpu_query(ws);
+
+    // snapshots got them on the UI thread
+    if (_pipeline_snapshot == nullptr)
+        imgui_use_sdf_shader(draw_data);
 
     int display_w, display_h;
-    glfwGetFramebufferSize(window, &display_w, &display_h);
+    _get_framebuffer_size(window, &display_w, &display_h);
     glViewport(0, 0, display_w, display_h);
     glClearColor(0, 0, 0, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    ImGui_ImplOpenGL3_RenderDrawData(draw_data);
+
+    if (gpu_query)
+        _end_gpu_query();
 
+    double submit_seconds = _seconds_since(&start);
+
+    get_time(&start);
     glfwSwapBuffers(window);
+    double swap_seconds = _seconds_since(&start);
+
+    _lock_frame_stats(ws);
+    window_frame_timing *frame = _current_frame(ws);
+    frame->submit_seconds = submit_seconds;
+    frame->swap_seconds = swap_seconds;
+    _unlock_frame_stats(ws);
 }
 
-void window_event_loop(GLFWwindow *window, event_loop_update_callback update, event_loop_render_callback render, double min_fps)
+// ImGui::Render, timed. The render thread of a pipelined loop gets the
+// snapshot instead, ImGui::Render ran on the UI thread.
+static ImDrawData *_render_imgui(GLFWwindow *window)
 {
-    double dt;
-    timespan start;
-    timespan now;
+    if (_pipeline_snapshot != nullptr)
+        return &_pipeline_snapshot->draw_data;
 
+    timespan start;
     get_time(&start);
-    now = start;
+    ImGui::Render();
+    _current_frame(_get_window_state(window))->render_seconds = _seconds_since(&start);
 
-    while (!glfwWindowShouldClose(window))
+    return ImGui::GetDrawData();
+}
+
+void default_render_function(GLFWwindow *window, double dt)
+{
+    (void)dt;
+    _present_draw_data(window, _render_imgui(window));
+}
+
+/* Skipping unchanged frames
+
+skip_unchanged_render_function hashes everything the backend draws: the
+vertices, indices and commands (clip rects, textures, offsets, counts) of
+all draw lists, the display rectangle and the framebuffer size. If the hash
+is the same as the one of the last presented frame, nothing is uploaded,
+drawn or swapped, the window keeps showing the last frame.
+Frames with user callbacks are always drawn since callbacks may draw
+anything, as are frames after the window was refreshed (uncovered, ...).
+
+Without the swap nothing waits for vsync anymore, so the frame after a
+skipped frame is due one refresh interval of the monitor after the last
+frame, presented or skipped, which keeps a polling loop from spinning.
+render doesn't wait itself (waiting for events there would run callbacks in
+the middle of render), the loop waits for events until the next frame is
+due and wakes up early on input. The render thread of a pipelined loop
+sleeps instead, the UI thread handles events meanwhile.
+
+The hash mixes 8 bytes at a time, draw data is mostly floats and indices,
+so it's a small fraction of what uploading it costs.
+*/
+static u64 _hash_bytes(u64 h, const void *data, s64 size)
+{
+    const u8 *p = (const u8*)data;
+    s64 words = size / 8;
+
+    for (s64 i = 0; i < words; ++i)
     {
-        if (min_fps > 0.0)
-            glfwWaitEventsTimeout(1.0 / min_fps);
-        else
-            glfwPollEvents();
+        u64 w;
+        copy_memory(p + i * 8, &w, 8);
+        h = (h ^ w) * 0x9e3779b97f4a7c15ull;
+        h ^= h >> 32;
+    }
 
-        get_time(&now);
-        dt = get_seconds_difference(&start, &now);
+    u64 rest = 0;
+    copy_memory(p + words * 8, &rest, size - words * 8);
+    h = (h ^ rest ^ (u64)size) * 0x9e3779b97f4a7c15ull;
+    h ^= h >> 32;
 
-        update(window, dt);
-        render(window, dt);
+    return h;
+}
 
-        start = now;
+#define _hash_value(H, V) _hash_bytes(H, &(V), sizeof(V))
+
+// sets has_callbacks if any list has user callbacks.
+static u64 _hash_draw_data(const ImDrawData *draw_data, bool *has_callbacks)
+{
+    u64 h = 0xcbf29ce484222325ull;
+    h = _hash_value(h, draw_data->DisplayPos);
+    h = _hash_value(h, draw_data->DisplaySize);
+    h = _hash_value(h, draw_data->FramebufferScale);
+    h = _hash_value(h, draw_data->CmdListsCount);
+
+    for (int i = 0; i < draw_data->CmdListsCount; ++i)
+    {
+        const ImDrawList *list = draw_data->CmdLists[i];
+        h = _hash_bytes(h, list->VtxBuffer.Data, (s64)list->VtxBuffer.Size * (s64)sizeof(ImDrawVert));
+        h = _hash_bytes(h, list->IdxBuffer.Data, (s64)list->IdxBuffer.Size * (s64)sizeof(ImDrawIdx));
+
+        for (int c = 0; c < list->CmdBuffer.Size; ++c)
+        {
+            const ImDrawCmd *cmd = &list->CmdBuffer[c];
+
+            if (cmd->UserCallback != nullptr && cmd->UserCallback != ImDrawCallback_ResetRenderState)
+                *has_callbacks = true;
+
+            ImTextureID texture = cmd->GetTexID();
+            h = _hash_value(h, cmd->ClipRect);
+            h = _hash_value(h, texture);
+            h = _hash_value(h, cmd->VtxOffset);
+            h = _hash_value(h, cmd->IdxOffset);
+            h = _hash_value(h, cmd->ElemCount);
+        }
     }
+
+    return h;
 }
 
-void imgui_init(GLFWwindow *window)
+static double _get_refresh_interval(GLFWwindow *window)
 {
-    ImGui::CreateContext();
-    ImGuiIO &io = ImGui::GetIO(); (void)io;
-    io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;     // Enable Keyboard Controls
-    io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;      // Enable Gamepad Controls
-    io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;
+    GLFWmonitor *monitor = glfwGetWindowMonitor(window);
 
-    ImGui_ImplGlfw_InitForOpenGL(window, true /* install callbacks */);
-    ImGui_ImplOpenGL3_Init(_glsl_version);
+    if (monitor == nullptr)
+        monitor = glfwGetPrimaryMonitor();
 
-    ui::filepicker_init();
-    ui::colorscheme_init();
+    const GLFWvidmode *mode = monitor != nullptr ? glfwGetVideoMode(monitor) : nullptr;
+
+    if (mode != nullptr && mode->refreshRate > 0)
+        return 1.0 / mode->refreshRate;
+
+    return 1.0 / 60.0;
 }
 
-void imgui_exit(GLFWwindow *window)
+static void _render_pipeline_sleep(window_render_pipeline *p, double seconds);
+
+// after a skipped frame, the loop waits for events this long before the next
+// frame. 0 if the last frame wasn't skipped or the next frame is due.
+static double _skipped_frame_wait(window_state *ws)
 {
-    (void)window;
+    if (!ws->skip_wait)
+        return 0.0;
 
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
+    double remaining = ws->interval - _seconds_since(&ws->interval_start);
 
-    ui::filepicker_exit(); // need to exit after imgui so imgui writes ini correctly
-    ui::colorscheme_free();
+    if (remaining <= 0.0)
+    {
+        ws->skip_wait = false;
+        return 0.0;
+    }
+
+    return remaining;
 }
 
-void imgui_new_frame()
+// polls events, or waits for them until the next frame is due after a
+// skipped frame.
+static void _poll_events(window_state *ws)
 {
-    ImGui_ImplOpenGL3_NewFrame();
-    ImGui_ImplGlfw_NewFrame();
-    ImGui::NewFrame();
+    double wait = _skipped_frame_wait(ws);
+
+    if (wait > 0.0)
+        glfwWaitEventsTimeout(wait);
+    else
+        glfwPollEvents();
 }
 
-void imgui_end_frame()
+// the frame after a skipped frame is due one refresh interval after the
+// last frame.
+static void _wait_for_next_frame(window_state *ws)
 {
-    ImGui::EndFrame();
+    double interval = _pipeline_snapshot != nullptr ? _pipeline_snapshot->refresh_interval
+                                                    : _get_refresh_interval(ws->window);
+
+    // a frame woken up early by input keeps the interval it's in
+    if (_seconds_since(&ws->interval_start) >= interval)
+        get_time(&ws->interval_start);
+
+    ws->interval = interval;
+
+    if (_pipeline_snapshot != nullptr)
+        _render_pipeline_sleep(ws->pipeline, interval - _seconds_since(&ws->interval_start));
+    else
+        ws->skip_wait = true;
 }
 
-void imgui_set_next_window_full_size()
+void skip_unchanged_render_function(GLFWwindow *window, double dt)
 {
-#ifdef IMGUI_HAS_VIEWPORT
-    ImGuiViewport* viewport = ImGui::GetMainViewport();
-    ImGui::SetNextWindowPos(viewport->WorkPos);
-    ImGui::SetNextWindowSize(viewport->WorkSize);
-    ImGui::SetNextWindowViewport(viewport->ID);
-#else 
-    ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f));
-    ImGui::SetNextWindowSize(ImGui::GetIO().DisplaySize);
-#endif
+    (void)dt;
+    ImDrawData *draw_data = _render_imgui(window);
+    window_state *ws = _get_window_state(window);
+
+    int display_w, display_h;
+    _get_framebuffer_size(window, &display_w, &display_h);
+
+    bool has_callbacks = false;
+    u64 h = _hash_draw_data(draw_data, &has_callbacks);
+    h = _hash_value(h, display_w);
+    h = _hash_value(h, display_h);
+
+    // snapshots have SDF callbacks, which don't count, and the UI thread
+    // tracks refreshes.
+    bool damaged = ws->damaged;
+
+    if (_pipeline_snapshot != nullptr)
+    {
+        has_callbacks = _pipeline_snapshot->has_callbacks;
+        damaged = _pipeline_snapshot->damaged;
+    }
+
+    if (ws->presented && !damaged && !has_callbacks && h == ws->draw_hash)
+    {
+        ws->skipped_frames += 1;
+
+        timespan start;
+        get_time(&start);
+        _wait_for_next_frame(ws);
+
+        double swap_seconds = _seconds_since(&start);
+
+        _lock_frame_stats(ws);
+        window_frame_timing *frame = _current_frame(ws);
+        frame->skipped = true;
+        frame->swap_seconds = swap_seconds;
+        _unlock_frame_stats(ws);
+        return;
+    }
+
+    _present_draw_data(window, draw_data);
+
+    ws->presented = true;
+    ws->draw_hash = h;
+    ws->skip_wait = false;
+
+    if (_pipeline_snapshot == nullptr)
+        ws->damaged = false;
+
+    get_time(&ws->interval_start);
 }
 
-unsigned int imgui_hash(const char *str)
+/* Idle event loop
+
+With window_LoopFlags_Idle the loop waits for events instead of polling, and
+runs one frame per wakeup. Activity makes it run WINDOW_IDLE_FRAMES frames
+without waiting, so ImGui can settle (hover states, layout of opened
+popups, ...):
+- input, i.e. events the ImGui backend queued.
+- a changed framebuffer size (resize, minimize, content scale).
+- a refresh, e.g. when the window is uncovered.
+- window_request_redraw, which also wakes the loop.
+After activity, the loop keeps running frames for up to
+WINDOW_IDLE_LINGER_SECONDS while ImGui needs them: the text cursor blinks,
+an item is active or hovered (tooltip delays), a mouse button is held, a
+modal background fades in, ...
+Update and render always run together, ImGui needs a Render for every
+NewFrame.
+*/
+#define WINDOW_IDLE_FRAMES         3
+#define WINDOW_IDLE_LINGER_SECONDS 1.0
+
+// frames ImGui would like to have, even without input
+static bool _imgui_wants_frames()
 {
-    return ImHashStr(str);
+    ImGuiContext *g = ImGui::GetCurrentContext();
+
+    if (g == nullptr)
+        return false;
+
+    return g->IO.WantTextInput
+        || g->ActiveId != 0
+        || g->HoveredId != 0
+        || ImGui::IsAnyMouseDown()
+        || g->NavWindowingTarget != nullptr
+        || (g->DimBgRatio > 0.0f && g->DimBgRatio < 1.0f);
 }
 
-void imgui_push_override_id(unsigned int id)
+static bool _window_had_activity(GLFWwindow *window, window_state *ws)
 {
-    ImGui::PushOverrideID(id);
+    bool ret = ws->refreshed;
+    ws->refreshed = false;
+
+    ImGuiContext *g = ImGui::GetCurrentContext();
+
+    if (g != nullptr && g->InputEventsQueue.Size > 0)
+        ret = true;
+
+    int w, h;
+    glfwGetFramebufferSize(window, &w, &h);
+
+    if (w != ws->framebuffer_width || h != ws->framebuffer_height)
+    {
+        ws->framebuffer_width = w;
+        ws->framebuffer_height = h;
+        ret = true;
+    }
+
+    return ret;
 }
 
-void imgui_pop_id()
+void window_request_redraw(GLFWwindow *window, int frames)
 {
-    ImGui::PopID();
+    window_state *ws = _get_window_state(window);
+
+    if (ws->redraw_frames < frames)
+        ws->redraw_frames = frames;
+
+    glfwPostEmptyEvent();
 }
 
-void imgui_open_global_popup(const char *id)
+/* Pipelined rendering
+
+With window_LoopFlags_Pipelined the loop runs on two threads: the calling
+(UI) thread handles events, runs update and ImGui::Render and copies the
+draw data into a snapshot, and a render thread that owns the window's GL
+context runs the render callback with it, so submitting and waiting for the
+swap of frame N overlap with building frame N + 1.
+
+There are two snapshots, one the render thread has and one the UI thread
+fills. The UI thread hands over a frame only after the render thread took
+the previous one, so it's at most one frame ahead and vsync still paces the
+loop. The copies keep their buffers between frames, copying is a memcpy of
+the vertices, indices and commands of every list.
+
+The UI thread has a hidden context that shares objects with the window's
+current, for the GL calls it still makes (backend device objects, font
+texture, dynamic glyphs). Every snapshot carries a fence of those commands
+the render thread waits for on the GPU before drawing.
+The render thread never calls GLFW functions that are main thread only, the
+window-base render functions take everything they'd query from the snapshot
+instead (see _pipeline_snapshot). It has the ImGui context of its window
+current (the current context is per thread, see cmake/imgui_config.hpp) so
+the OpenGL backend draws with the backend data (program, buffers) of that
+context, which the UI thread only sets up before the first frame.
+*/
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_TIMEOUT_IGNORED
+#define GL_TIMEOUT_IGNORED            0xFFFFFFFFFFFFFFFFull
+#endif
+
+struct window_sync_functions
 {
-    ImGui::PushOverrideID(ImHashStr(id));
-    ImGui::OpenPopup(id);
-    ImGui::PopID();
+    bool loaded;
+    bool available;
+    void *(APIENTRY *FenceSync)(GLenum condition, GLbitfield flags);
+    void (APIENTRY *WaitSync)(void *sync, GLbitfield flags, unsigned long long timeout);
+    void (APIENTRY *DeleteSync)(void *sync);
+};
+
+static window_sync_functions _sync_functions{};
+
+static window_sync_functions *_get_sync_functions()
+{
+    window_sync_functions *f = &_sync_functions;
+
+    if (!f->loaded)
+    {
+        f->loaded = true;
+        f->available = _load_gl_function(f, FenceSync)
+                    && _load_gl_function(f, WaitSync)
+                    && _load_gl_function(f, DeleteSync);
+    }
+
+    return f->available ? f : nullptr;
+}
+
+struct window_render_pipeline
+{
+    GLFWwindow *window;
+    GLFWwindow *upload_context;     // hidden, current on the UI thread
+    window_state *state;
+    event_loop_render_callback render;
+    double refresh_interval;
+
+    window_draw_snapshot snapshots[2];
+    int pending;                    // snapshot the render thread takes next, -1 = none
+    int rendering;                  // snapshot the render thread has, -1 = none
+    bool quit;
+    bool wake_main_thread;          // post an empty event when a snapshot is taken
+
+#if Windows
+    SRWLOCK lock;
+    CONDITION_VARIABLE changed;
+    HANDLE thread;
+#elif Linux
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t thread;
+#endif
+};
+
+static void _pipeline_lock(window_render_pipeline *p)
+{
+#if Windows
+    AcquireSRWLockExclusive(&p->lock);
+#elif Linux
+    pthread_mutex_lock(&p->lock);
+#endif
+}
+
+static void _pipeline_unlock(window_render_pipeline *p)
+{
+#if Windows
+    ReleaseSRWLockExclusive(&p->lock);
+#elif Linux
+    pthread_mutex_unlock(&p->lock);
+#endif
+}
+
+// both threads wait for changes of pending, rendering or quit.
+static void _pipeline_signal(window_render_pipeline *p)
+{
+#if Windows
+    WakeAllConditionVariable(&p->changed);
+#elif Linux
+    pthread_cond_broadcast(&p->changed);
+#endif
+}
+
+// locked
+static void _pipeline_wait(window_render_pipeline *p)
+{
+#if Windows
+    SleepConditionVariableSRW(&p->changed, &p->lock, INFINITE, 0);
+#elif Linux
+    pthread_cond_wait(&p->changed, &p->lock);
+#endif
+}
+
+// sleeps on the render thread, wakes up early only to quit.
+static void _render_pipeline_sleep(window_render_pipeline *p, double seconds)
+{
+    timespan start;
+    get_time(&start);
+
+    _pipeline_lock(p);
+
+    while (!p->quit)
+    {
+        double remaining = seconds - _seconds_since(&start);
+
+        if (remaining <= 0.0)
+            break;
+
+#if Windows
+        SleepConditionVariableSRW(&p->changed, &p->lock, (DWORD)(remaining * 1000.0) + 1, 0);
+#elif Linux
+        timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        s64 ns = until.tv_nsec + (s64)(remaining * 1000000000.0);
+        until.tv_sec += ns / 1000000000;
+        until.tv_nsec = ns % 1000000000;
+        pthread_cond_timedwait(&p->changed, &p->lock, &until);
+#endif
+    }
+
+    _pipeline_unlock(p);
+}
+
+template<typename T>
+static void _copy_vector(ImVector<T> *dst, const ImVector<T> *src)
+{
+    // resize keeps the capacity, assignment would reallocate
+    dst->resize(src->Size);
+
+    if (src->Size > 0)
+        copy_memory(src->Data, dst->Data, (s64)src->Size * (s64)sizeof(T));
+}
+
+static void _copy_draw_data(window_draw_snapshot *snap, const ImDrawData *src)
+{
+    while (snap->lists.Size < src->CmdListsCount)
+        snap->lists.push_back(IM_NEW(ImDrawList)(nullptr));
+
+    ImDrawData *dst = &snap->draw_data;
+    dst->Valid = src->Valid;
+    dst->CmdListsCount = src->CmdListsCount;
+    dst->TotalIdxCount = src->TotalIdxCount;
+    dst->TotalVtxCount = src->TotalVtxCount;
+    dst->DisplayPos = src->DisplayPos;
+    dst->DisplaySize = src->DisplaySize;
+    dst->FramebufferScale = src->FramebufferScale;
+    dst->OwnerViewport = src->OwnerViewport;
+    dst->CmdLists.resize(src->CmdListsCount);
+
+    for (int i = 0; i < src->CmdListsCount; ++i)
+    {
+        const ImDrawList *from = src->CmdLists[i];
+        ImDrawList *to = snap->lists[i];
+
+        _copy_vector(&to->CmdBuffer, &from->CmdBuffer);
+        _copy_vector(&to->IdxBuffer, &from->IdxBuffer);
+        _copy_vector(&to->VtxBuffer, &from->VtxBuffer);
+        to->Flags = from->Flags;
+
+#if IMGUI_VERSION_NUM >= 19140
+        // callback data ImGui copied is in the list, point to the copy
+        _copy_vector(&to->CallbacksDataBuf, &from->CallbacksDataBuf);
+
+        for (int c = 0; c < to->CmdBuffer.Size; ++c)
+        {
+            ImDrawCmd *cmd = &to->CmdBuffer[c];
+
+            if (cmd->UserCallback != nullptr && cmd->UserCallbackDataSize > 0)
+                cmd->UserCallbackData = to->CallbacksDataBuf.Data + cmd->UserCallbackDataOffset;
+        }
+#endif
+
+        dst->CmdLists[i] = to;
+    }
+}
+
+static void _free_snapshot(window_draw_snapshot *snap)
+{
+    for (int i = 0; i < snap->lists.Size; ++i)
+        IM_DELETE(snap->lists[i]);
+
+    snap->lists.clear();
+    snap->draw_data.CmdLists.clear();
+}
+
+static bool _has_user_callbacks(const ImDrawData *draw_data)
+{
+    for (int i = 0; i < draw_data->CmdListsCount; ++i)
+    {
+        const ImDrawList *list = draw_data->CmdLists[i];
+
+        for (int c = 0; c < list->CmdBuffer.Size; ++c)
+            if (list->CmdBuffer[c].UserCallback != nullptr
+             && list->CmdBuffer[c].UserCallback != ImDrawCallback_ResetRenderState)
+                return true;
+    }
+
+    return false;
+}
+
+#if Windows
+static DWORD WINAPI _render_thread(LPVOID _pipeline)
+#elif Linux
+static void *_render_thread(void *_pipeline)
+#endif
+{
+    window_render_pipeline *p = (window_render_pipeline*)_pipeline;
+    glfwMakeContextCurrent(p->window);
+    ImGui::SetCurrentContext(p->state->imgui_context);
+
+    while (true)
+    {
+        _pipeline_lock(p);
+
+        while (p->pending < 0 && !p->quit)
+            _pipeline_wait(p);
+
+        // frames handed over before quitting are still rendered
+        if (p->pending < 0)
+        {
+            _pipeline_unlock(p);
+            break;
+        }
+
+        p->rendering = p->pending;
+        p->pending = -1;
+        _pipeline_signal(p);
+        _pipeline_unlock(p);
+
+        if (p->wake_main_thread)
+            glfwPostEmptyEvent();
+
+        window_draw_snapshot *snap = p->snapshots + p->rendering;
+
+        if (snap->fence != nullptr)
+        {
+            window_sync_functions *f = _get_sync_functions();
+            f->WaitSync(snap->fence, 0, GL_TIMEOUT_IGNORED);
+            f->DeleteSync(snap->fence);
+            snap->fence = nullptr;
+        }
+
+        _pipeline_snapshot = snap;
+        _read_available_gpu_queries(p->state);
+        p->render(p->window, snap->dt);
+        _pipeline_snapshot = nullptr;
+
+        _pipeline_lock(p);
+        p->rendering = -1;
+        _pipeline_signal(p);
+        _pipeline_unlock(p);
+    }
+
+    glfwMakeContextCurrent(nullptr);
+
+#if Windows
+    return 0;
+#elif Linux
+    return nullptr;
+#endif
+}
+
+// nullptr if the hidden context or the thread can't be created, the loop
+// then renders on the calling thread.
+static window_render_pipeline *_start_render_pipeline(GLFWwindow *window, event_loop_render_callback render)
+{
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *upload_context = glfwCreateWindow(1, 1, "", nullptr, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+    if (upload_context == nullptr)
+        return nullptr;
+
+    window_render_pipeline *p = alloc<window_render_pipeline>();
+    fill_memory(p, 0);
+    p->window = window;
+    p->upload_context = upload_context;
+    p->state = _get_window_state(window);
+    p->render = render;
+    p->refresh_interval = _get_refresh_interval(window);
+    p->pending = -1;
+    p->rendering = -1;
+
+    // loaded once with the window's context current, render threads only
+    // read them.
+    _get_gpu_query_functions();
+    _get_sync_functions();
+
+    // a context can only be current on one thread
+    glfwMakeContextCurrent(upload_context);
+
+#if Windows
+    InitializeSRWLock(&p->lock);
+    InitializeConditionVariable(&p->changed);
+    p->thread = CreateThread(nullptr, 0, _render_thread, p, 0, nullptr);
+    bool started = p->thread != nullptr;
+#elif Linux
+    pthread_mutex_init(&p->lock, nullptr);
+    pthread_cond_init(&p->changed, nullptr);
+    bool started = pthread_create(&p->thread, nullptr, _render_thread, p) == 0;
+#endif
+
+    if (!started)
+    {
+#if Linux
+        pthread_cond_destroy(&p->changed);
+        pthread_mutex_destroy(&p->lock);
+#endif
+        glfwMakeContextCurrent(window);
+        glfwDestroyWindow(upload_context);
+        dealloc(p);
+        return nullptr;
+    }
+
+    p->state->pipeline = p;
+    return p;
+}
+
+static void _stop_render_pipeline(window_render_pipeline *p)
+{
+    _pipeline_lock(p);
+    p->quit = true;
+    _pipeline_signal(p);
+    _pipeline_unlock(p);
+
+#if Windows
+    WaitForSingleObject(p->thread, INFINITE);
+    CloseHandle(p->thread);
+#elif Linux
+    pthread_join(p->thread, nullptr);
+    pthread_cond_destroy(&p->changed);
+    pthread_mutex_destroy(&p->lock);
+#endif
+
+    // as before the loop, e.g. for imgui_exit
+    glfwMakeContextCurrent(p->window);
+    glfwDestroyWindow(p->upload_context);
+
+    _free_snapshot(p->snapshots + 0);
+    _free_snapshot(p->snapshots + 1);
+
+    p->state->pipeline = nullptr;
+    dealloc(p);
+}
+
+// whether _submit_to_render_pipeline would not wait
+static bool _render_pipeline_ready(window_render_pipeline *p)
+{
+    _pipeline_lock(p);
+    bool ret = p->pending < 0;
+    _pipeline_unlock(p);
+
+    return ret;
+}
+
+// ImGui::Render on the UI thread and hands the frame to the render thread.
+static void _submit_to_render_pipeline(window_render_pipeline *p, double dt)
+{
+    window_state *ws = p->state;
+
+    // wait for the render thread to take the last frame, then the snapshot
+    // it doesn't have is free.
+    _pipeline_lock(p);
+
+    while (p->pending >= 0)
+        _pipeline_wait(p);
+
+    int index = p->rendering == 0 ? 1 : 0;
+    _pipeline_unlock(p);
+
+    timespan start;
+    get_time(&start);
+
+    ImGui::Render();
+    ImDrawData *draw_data = ImGui::GetDrawData();
+
+    window_draw_snapshot *snap = p->snapshots + index;
+    snap->has_callbacks = _has_user_callbacks(draw_data);
+    imgui_use_sdf_shader(draw_data);
+    _copy_draw_data(snap, draw_data);
+
+    int w, h;
+    glfwGetFramebufferSize(p->window, &w, &h);
+
+    // the window may have moved to another monitor
+    if (w != snap->framebuffer_width || h != snap->framebuffer_height || ws->damaged)
+        p->refresh_interval = _get_refresh_interval(p->window);
+
+    snap->state = ws;
+    snap->dt = dt;
+    snap->frame = ws->frame_count;
+    snap->framebuffer_width = w;
+    snap->framebuffer_height = h;
+    snap->refresh_interval = p->refresh_interval;
+    snap->damaged = ws->damaged;
+    ws->damaged = false;
+
+    window_sync_functions *f = _get_sync_functions();
+
+    if (f != nullptr)
+    {
+        snap->fence = f->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+    }
+    else
+        glFinish();
+
+    _current_frame(ws)->render_seconds = _seconds_since(&start);
+
+    _pipeline_lock(p);
+    p->pending = index;
+    _pipeline_signal(p);
+    _pipeline_unlock(p);
+}
+
+void window_event_loop(GLFWwindow *window, event_loop_update_callback update, event_loop_render_callback render, double min_fps, window_LoopFlags flags)
+{
+    double dt;
+    timespan start;
+    timespan now;
+    timespan last_activity;
+    timespan frame_start;
+    timespan update_end;
+    bool idle = (flags & window_LoopFlags_Idle) != 0;
+    window_render_pipeline *pipeline = nullptr;
+
+    if (window_state *ws = _get_window_state(window); ws->imgui_context != nullptr)
+        ImGui::SetCurrentContext(ws->imgui_context);
+
+    if (flags & window_LoopFlags_Pipelined)
+        pipeline = _start_render_pipeline(window, render);
+
+    // the first frame always runs
+    if (idle)
+        _get_window_state(window)->redraw_frames = WINDOW_IDLE_FRAMES;
+
+    get_time(&start);
+    now = start;
+    last_activity = start;
+
+    while (!glfwWindowShouldClose(window))
+    {
+        get_time(&frame_start);
+        _begin_frame(_get_window_state(window));
+
+        if (idle)
+        {
+            window_state *ws = _get_window_state(window);
+
+            bool busy = ws->redraw_frames > 0
+                     || (_imgui_wants_frames() && get_seconds_difference(&last_activity, &now) < WINDOW_IDLE_LINGER_SECONDS);
+
+            if (busy)
+                _poll_events(ws);
+            else if (min_fps > 0.0)
+                glfwWaitEventsTimeout(1.0 / min_fps);
+            else
+                glfwWaitEvents();
+
+            // callbacks may have added window states
+            ws = _get_window_state(window);
+
+            if (_window_had_activity(window, ws))
+            {
+                if (ws->redraw_frames < WINDOW_IDLE_FRAMES)
+                    ws->redraw_frames = WINDOW_IDLE_FRAMES;
+
+                get_time(&last_activity);
+            }
+
+            if (ws->redraw_frames > 0)
+                ws->redraw_frames -= 1;
+        }
+        else if (min_fps > 0.0)
+            glfwWaitEventsTimeout(1.0 / min_fps);
+        else
+            _poll_events(_get_window_state(window));
+
+        get_time(&now);
+        dt = get_seconds_difference(&start, &now);
+
+        update(window, dt);
+        get_time(&update_end);
+
+        if (pipeline != nullptr)
+            _submit_to_render_pipeline(pipeline, dt);
+        else
+            render(window, dt);
+
+        // callbacks may have added window states
+        window_state *ws = _get_window_state(window);
+        window_frame_timing *frame = _current_frame(ws);
+        frame->wait_seconds = get_seconds_difference(&frame_start, &now);
+        frame->update_seconds = get_seconds_difference(&now, &update_end);
+        frame->frame_seconds = _seconds_since(&now);
+        ws->frame_count += 1;
+
+        start = now;
+    }
+
+    if (pipeline != nullptr)
+        _stop_render_pipeline(pipeline);
+}
+
+/* Multiple windows
+
+Every window has its own ImGui context (imgui_init), all of them draw with
+one font atlas (_shared_atlas) that is freed after the last context exited,
+and all GL contexts share objects (window_create), so the atlas texture, SDF
+programs and textures of the application work in every window.
+The ImGui GLFW backend looks up its data in the current ImGui context, but
+events of all windows are handled by one glfwPollEvents, so the callbacks
+the backend installs are wrapped by callbacks that make the context of the
+window current first.
+The atlas texture belongs to the OpenGL backend of one context, the backends
+of later contexts delete the copy they create with their device objects
+right away. If the context with the texture exits first, another one
+creates it again.
+
+The multi window loop runs one frame of every window that wants one per
+iteration, with the window's ImGui context and GL context (the hidden one of
+its pipeline if pipelined) current. Pipelined windows whose render thread
+didn't take the last frame yet are skipped instead of waited for, and
+render threads wake the loop with an empty event when they take a frame, so
+each window runs at the rate of its own render thread. Switching contexts on
+the UI thread doesn't affect the render threads, see cmake/imgui_config.hpp.
+*/
+#define _define_imgui_callback(Name, Params, Args) \
+    static void _imgui_##Name##_callback Params \
+    { \
+        window_state *ws = _get_window_state(window); \
+        ImGuiContext *previous = ImGui::GetCurrentContext(); \
+        ImGui::SetCurrentContext(ws->imgui_context); \
+        if (ws->imgui_callbacks.Name != nullptr) \
+            ws->imgui_callbacks.Name Args; \
+        ImGui::SetCurrentContext(previous); \
+    }
+
+_define_imgui_callback(window_focus, (GLFWwindow *window, int focused), (window, focused))
+_define_imgui_callback(cursor_enter, (GLFWwindow *window, int entered), (window, entered))
+_define_imgui_callback(cursor_pos,   (GLFWwindow *window, double x, double y), (window, x, y))
+_define_imgui_callback(mouse_button, (GLFWwindow *window, int button, int action, int mods), (window, button, action, mods))
+_define_imgui_callback(scroll,       (GLFWwindow *window, double x, double y), (window, x, y))
+_define_imgui_callback(key,          (GLFWwindow *window, int key, int scancode, int action, int mods), (window, key, scancode, action, mods))
+_define_imgui_callback(character,    (GLFWwindow *window, unsigned int c), (window, c))
+
+// after the backend installed its callbacks
+static void _wrap_imgui_callbacks(GLFWwindow *window, window_imgui_callbacks *cbs)
+{
+    cbs->window_focus = glfwSetWindowFocusCallback(window, _imgui_window_focus_callback);
+    cbs->cursor_enter = glfwSetCursorEnterCallback(window, _imgui_cursor_enter_callback);
+    cbs->cursor_pos   = glfwSetCursorPosCallback(window, _imgui_cursor_pos_callback);
+    cbs->mouse_button = glfwSetMouseButtonCallback(window, _imgui_mouse_button_callback);
+    cbs->scroll       = glfwSetScrollCallback(window, _imgui_scroll_callback);
+    cbs->key          = glfwSetKeyCallback(window, _imgui_key_callback);
+    cbs->character    = glfwSetCharCallback(window, _imgui_character_callback);
+}
+
+// an ImGui context of another window than window, nullptr if there is none
+static ImFontAtlas *_shared_atlas = nullptr;
+
+static ImGuiContext *_other_imgui_context(GLFWwindow *window)
+{
+    for_array(ws, &_window_states)
+        if ((*ws)->window != window && (*ws)->imgui_context != nullptr)
+            return (*ws)->imgui_context;
+
+    return nullptr;
+}
+
+struct window_loop_entry
+{
+    GLFWwindow *window;
+    window_render_pipeline *pipeline;
+    timespan last_frame;
+    timespan last_activity;
+    bool closed;
+};
+
+static void _make_loop_window_current(window_loop_entry *e)
+{
+    window_state *ws = _get_window_state(e->window);
+
+    if (ws->imgui_context != nullptr)
+        ImGui::SetCurrentContext(ws->imgui_context);
+
+    glfwMakeContextCurrent(e->pipeline != nullptr ? e->pipeline->upload_context : e->window);
+}
+
+// without looking at events, which aren't handled yet
+static bool _loop_window_wants_frame(window_loop_entry *e, bool idle)
+{
+    if (e->pipeline != nullptr && !_render_pipeline_ready(e->pipeline))
+        return false;
+
+    if (!idle)
+        return true;
+
+    window_state *ws = _get_window_state(e->window);
+
+    if (ws->imgui_context != nullptr)
+        ImGui::SetCurrentContext(ws->imgui_context);
+
+    return ws->redraw_frames > 0
+        || (_imgui_wants_frames() && _seconds_since(&e->last_activity) < WINDOW_IDLE_LINGER_SECONDS);
+}
+
+static void _run_loop_frame(window_loop_entry *e, event_loop_update_callback update, event_loop_render_callback render, double wait_seconds)
+{
+    _begin_frame(_get_window_state(e->window));
+
+    timespan now;
+    timespan update_end;
+    get_time(&now);
+    double dt = get_seconds_difference(&e->last_frame, &now);
+    e->last_frame = now;
+
+    update(e->window, dt);
+    get_time(&update_end);
+
+    if (e->pipeline != nullptr)
+        _submit_to_render_pipeline(e->pipeline, dt);
+    else
+        render(e->window, dt);
+
+    window_state *ws = _get_window_state(e->window);
+    window_frame_timing *frame = _current_frame(ws);
+    frame->wait_seconds = wait_seconds;
+    frame->update_seconds = get_seconds_difference(&now, &update_end);
+    frame->frame_seconds = _seconds_since(&now);
+    ws->frame_count += 1;
+}
+
+void window_event_loop(GLFWwindow **windows, int window_count, event_loop_update_callback update, event_loop_render_callback render, double min_fps, window_LoopFlags flags)
+{
+    bool idle = (flags & window_LoopFlags_Idle) != 0;
+    array<window_loop_entry> entries{};
+    defer { free(&entries); };
+
+    timespan now;
+    get_time(&now);
+
+    for (int i = 0; i < window_count; ++i)
+    {
+        window_loop_entry *e = add_at_end(&entries);
+        fill_memory(e, 0);
+        e->window = windows[i];
+        e->last_frame = now;
+        e->last_activity = now;
+
+        if (flags & window_LoopFlags_Pipelined)
+            e->pipeline = _start_render_pipeline(windows[i], render);
+
+        if (e->pipeline != nullptr)
+            e->pipeline->wake_main_thread = true;
+
+        // the first frame always runs
+        if (idle)
+            _get_window_state(windows[i])->redraw_frames = WINDOW_IDLE_FRAMES;
+    }
+
+    int open_count = window_count;
+
+    while (open_count > 0)
+    {
+        bool any_wants_frame = false;
+        double wait = min_fps > 0.0 ? 1.0 / min_fps : -1.0;
+
+        for_array(e, &entries)
+        {
+            if (e->closed || !_loop_window_wants_frame(e, idle))
+                continue;
+
+            // skipped its last frame, the next one is due later
+            double skip_wait = _skipped_frame_wait(_get_window_state(e->window));
+
+            if (skip_wait <= 0.0)
+                any_wants_frame = true;
+            else if (wait < 0.0 || skip_wait < wait)
+                wait = skip_wait;
+        }
+
+        timespan wait_start;
+        get_time(&wait_start);
+
+        if (any_wants_frame)
+            glfwPollEvents();
+        else if (wait > 0.0)
+            glfwWaitEventsTimeout(wait);
+        else
+            glfwWaitEvents();
+
+        double wait_seconds = _seconds_since(&wait_start);
+
+        for_array(e, &entries)
+        {
+            if (e->closed)
+                continue;
+
+            // closed windows are hidden, the application destroys them
+            if (glfwWindowShouldClose(e->window))
+            {
+                if (e->pipeline != nullptr)
+                    _stop_render_pipeline(e->pipeline);
+
+                e->pipeline = nullptr;
+                e->closed = true;
+                open_count -= 1;
+                glfwHideWindow(e->window);
+                continue;
+            }
+
+            _make_loop_window_current(e);
+            window_state *ws = _get_window_state(e->window);
+            bool activity = _window_had_activity(e->window, ws);
+
+            if (idle && activity)
+            {
+                if (ws->redraw_frames < WINDOW_IDLE_FRAMES)
+                    ws->redraw_frames = WINDOW_IDLE_FRAMES;
+
+                get_time(&e->last_activity);
+            }
+
+            // see Skipping unchanged frames, input wakes it up early
+            if (!activity && _skipped_frame_wait(ws) > 0.0)
+                continue;
+
+            // a slow render thread only slows down its own window
+            if (e->pipeline != nullptr && !_render_pipeline_ready(e->pipeline))
+                continue;
+
+            if (idle)
+            {
+                bool due = min_fps > 0.0 && _seconds_since(&e->last_frame) >= 1.0 / min_fps;
+                bool busy = ws->redraw_frames > 0
+                         || (_imgui_wants_frames() && _seconds_since(&e->last_activity) < WINDOW_IDLE_LINGER_SECONDS);
+
+                if (!busy && !due)
+                    continue;
+
+                if (ws->redraw_frames > 0)
+                    ws->redraw_frames -= 1;
+            }
+
+            _run_loop_frame(e, update, render, wait_seconds);
+        }
+    }
+
+    // as after window_create, e.g. for imgui_exit
+    if (window_count > 0)
+        glfwMakeContextCurrent(windows[0]);
+}
+
+/* Frame stats
+
+window_event_loop times every frame into a ring of WINDOW_FRAME_STATS_COUNT
+frames per window, the render functions add their stages (see
+_render_imgui and _present_draw_data) to the current frame, and GPU times
+arrive a few frames later, see GPU timer queries.
+Frame time excludes waiting for events, so idle time doesn't count as slow
+frames.
+*/
+static void _begin_frame(window_state *ws)
+{
+    // the render thread does, it has the context
+    if (ws->pipeline == nullptr)
+        _read_available_gpu_queries(ws);
+
+    _lock_frame_stats(ws);
+    window_frame_timing *frame = _current_frame(ws);
+    fill_memory(frame, 0);
+    frame->gpu_seconds = -1.0;
+    _unlock_frame_stats(ws);
+}
+
+static int _compare_doubles(const double *lhs, const double *rhs)
+{
+    if (*lhs < *rhs) return -1;
+    if (*lhs > *rhs) return  1;
+
+    return 0;
+}
+
+bool window_get_frame_stats(GLFWwindow *window, window_frame_stats *out)
+{
+    window_state *ws = nullptr;
+
+    for_array(s, &_window_states)
+        if ((*s)->window == window)
+            ws = *s;
+
+    if (ws == nullptr || ws->frame_count == 0)
+        return false;
+
+    // the current frame isn't done yet
+    s64 count = ws->frame_count < WINDOW_FRAME_STATS_COUNT ? ws->frame_count : WINDOW_FRAME_STATS_COUNT - 1;
+    s64 first = ws->frame_count - count;
+
+    double sorted[WINDOW_FRAME_STATS_COUNT];
+
+    _lock_frame_stats(ws);
+
+    for (s64 i = 0; i < count; ++i)
+    {
+        out->frames[i] = ws->frames[(first + i) % WINDOW_FRAME_STATS_COUNT];
+        sorted[i] = out->frames[i].frame_seconds;
+    }
+
+    _unlock_frame_stats(ws);
+
+    out->frame_count = (int)count;
+    out->total_frames = ws->frame_count;
+
+    sort(sorted, count, _compare_doubles);
+    out->frame_p50 = sorted[(count - 1) * 50 / 100];
+    out->frame_p90 = sorted[(count - 1) * 90 / 100];
+    out->frame_p99 = sorted[(count - 1) * 99 / 100];
+    out->frame_max = sorted[count - 1];
+
+    return true;
+}
+
+void imgui_init(GLFWwindow *window)
+{
+    // see Multiple windows
+    ImGuiContext *other = _other_imgui_context(window);
+
+    if (_shared_atlas == nullptr)
+        _shared_atlas = IM_NEW(ImFontAtlas)();
+
+    ImGuiContext *context = ImGui::CreateContext(_shared_atlas);
+    ImGui::SetCurrentContext(context);
+    _get_window_state(window)->imgui_context = context;
+
+    // the backend looks at the GL context
+    glfwMakeContextCurrent(window);
+
+    ImGuiIO &io = ImGui::GetIO(); (void)io;
+    io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;     // Enable Keyboard Controls
+    io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;      // Enable Gamepad Controls
+    io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;
+
+    // imgui.ini is the first window's
+    if (other != nullptr)
+        io.IniFilename = nullptr;
+
+    ImGui_ImplGlfw_InitForOpenGL(window, true /* install callbacks */);
+    _wrap_imgui_callbacks(window, &_get_window_state(window)->imgui_callbacks);
+    ImGui_ImplOpenGL3_Init(_glsl_version);
+
+    // the atlas already has a texture, only the first backend keeps its own.
+    // deleting the copy clears the texture of the atlas.
+    if (other != nullptr)
+    {
+        ImTextureID atlas_texture = _shared_atlas->TexID;
+        ImGui_ImplOpenGL3_CreateDeviceObjects();
+        ImGui_ImplOpenGL3_DestroyFontsTexture();
+        _shared_atlas->TexID = atlas_texture;
+    }
+
+    ui::filepicker_init();
+    ui::colorscheme_init();
+}
+
+void imgui_exit(GLFWwindow *window)
+{
+    window_state *ws = _get_window_state(window);
+
+    if (ws->imgui_context != nullptr)
+        ImGui::SetCurrentContext(ws->imgui_context);
+
+    glfwMakeContextCurrent(window);
+
+    ImGuiContext *context = ImGui::GetCurrentContext();
+    ImGuiContext *other = _other_imgui_context(window);
+    ImTextureID atlas_texture = _shared_atlas->TexID;
+
+    ImGui_ImplOpenGL3_Shutdown();
+
+    // this backend had the atlas texture, the backend of another context
+    // takes over. all GL contexts share the texture.
+    if (other != nullptr && atlas_texture != (ImTextureID)0 && _shared_atlas->TexID == (ImTextureID)0)
+    {
+        ImGui::SetCurrentContext(other);
+        ImGui_ImplOpenGL3_CreateFontsTexture();
+        ImGui::SetCurrentContext(context);
+    }
+
+    ImGui_ImplGlfw_Shutdown();
+
+    ImGui::DestroyContext(context);
+    ws->imgui_context = nullptr;
+    ImGui::SetCurrentContext(other);
+
+    if (other == nullptr)
+    {
+        IM_DELETE(_shared_atlas);
+        _shared_atlas = nullptr;
+        imgui_fonts_exit(); // after the atlas is gone
+    }
+
+    ui::filepicker_exit(); // need to exit after imgui so imgui writes ini correctly
+    ui::colorscheme_free();
+}
+
+void imgui_new_frame()
+{
+    // before the backend may create the font texture
+    imgui_update_dynamic_glyphs();
+
+    ImGui_ImplOpenGL3_NewFrame();
+    ImGui_ImplGlfw_NewFrame();
+    ImGui::NewFrame();
+}
+
+void imgui_end_frame()
+{
+    ImGui::EndFrame();
+}
+
+void imgui_set_next_window_full_size()
+{
+#ifdef IMGUI_HAS_VIEWPORT
+    ImGuiViewport* viewport = ImGui::GetMainViewport();
+    ImGui::SetNextWindowPos(viewport->WorkPos);
+    ImGui::SetNextWindowSize(viewport->WorkSize);
+    ImGui::SetNextWindowViewport(viewport->ID);
+#else 
+    ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f));
+    ImGui::SetNextWindowSize(ImGui::GetIO().DisplaySize);
+#endif
+}
+
+unsigned int imgui_hash(const char *str)
+{
+    return ImHashStr(str);
+}
+
+void imgui_push_override_id(unsigned int id)
+{
+    ImGui::PushOverrideID(id);
+}
+
+void imgui_pop_id()
+{
+    ImGui::PopID();
+}
+
+void imgui_open_global_popup(const char *id)
+{
+    ImGui::PushOverrideID(ImHashStr(id));
+    ImGui::OpenPopup(id);
+    ImGui::PopID();
+}
+
+static float _frame_ms_getter(void *data, int index)
+{
+    const window_frame_stats *stats = (const window_frame_stats*)data;
+    return (float)(stats->frames[index].frame_seconds * 1000.0);
+}
+
+void imgui_frame_stats_overlay(GLFWwindow *window, bool *open)
+{
+    if (open != nullptr && !*open)
+        return;
+
+    // too large for the stack of some threads
+    static window_frame_stats stats;
+
+    if (!window_get_frame_stats(window, &stats))
+        return;
+
+    double sum[6] = {};
+    double gpu_sum = 0.0;
+    int gpu_count = 0;
+    int skipped = 0;
+
+    for (int i = 0; i < stats.frame_count; ++i)
+    {
+        const window_frame_timing *f = stats.frames + i;
+        sum[0] += f->wait_seconds;
+        sum[1] += f->update_seconds;
+        sum[2] += f->render_seconds;
+        sum[3] += f->submit_seconds;
+        sum[4] += f->swap_seconds;
+        sum[5] += f->frame_seconds;
+
+        if (f->gpu_seconds >= 0.0)
+        {
+            gpu_sum += f->gpu_seconds;
+            gpu_count += 1;
+        }
+
+        if (f->skipped)
+            skipped += 1;
+    }
+
+    double n = stats.frame_count > 0 ? (double)stats.frame_count : 1.0;
+    const float pad = 10.0f;
+
+#ifdef IMGUI_HAS_VIEWPORT
+    const ImGuiViewport *viewport = ImGui::GetMainViewport();
+    ImVec2 corner(viewport->WorkPos.x + viewport->WorkSize.x - pad, viewport->WorkPos.y + pad);
+    ImGui::SetNextWindowViewport(viewport->ID);
+#else
+    ImVec2 corner(ImGui::GetIO().DisplaySize.x - pad, pad);
+#endif
+
+    ImGui::SetNextWindowPos(corner, ImGuiCond_Always, ImVec2(1.0f, 0.0f));
+    ImGui::SetNextWindowBgAlpha(0.75f);
+
+    ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize
+                           | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing
+                           | ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoMove;
+
+    if (ImGui::Begin("Frame stats", open, flags))
+    {
+        ImGui::Text("%d frames (%d skipped), %lld total", stats.frame_count, skipped, stats.total_frames);
+        ImGui::Text("frame  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f ms",
+                    stats.frame_p50 * 1000.0, stats.frame_p90 * 1000.0,
+                    stats.frame_p99 * 1000.0, stats.frame_max * 1000.0);
+        ImGui::Separator();
+        ImGui::Text("avg  wait   %7.2f ms", sum[0] / n * 1000.0);
+        ImGui::Text("     update %7.2f ms", sum[1] / n * 1000.0);
+        ImGui::Text("     render %7.2f ms", sum[2] / n * 1000.0);
+        ImGui::Text("     submit %7.2f ms", sum[3] / n * 1000.0);
+        ImGui::Text("     swap   %7.2f ms", sum[4] / n * 1000.0);
+        ImGui::Text("     frame  %7.2f ms", sum[5] / n * 1000.0);
+
+        if (gpu_count > 0)
+            ImGui::Text("     gpu    %7.2f ms", gpu_sum / gpu_count * 1000.0);
+        else
+            ImGui::TextUnformatted("     gpu        n/a");
+
+        ImGui::PlotLines("##frame_times", _frame_ms_getter, &stats, stats.frame_count, 0,
+                         "frame ms", 0.0f, (float)(stats.frame_p99 * 1000.0) * 1.5f, ImVec2(260.0f, 60.0f));
+    }
+
+    ImGui::End();
 }
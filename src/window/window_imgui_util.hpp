@@ -6,6 +6,8 @@ struct GLFWwindow;
 void window_init();
 void window_exit();
 
+// Windows share GL objects (textures, buffers, programs) with the first
+// window created.
 GLFWwindow *window_create(const char *title, int width, int height);
 void window_close(GLFWwindow *window);
 void window_destroy(GLFWwindow *window);
@@ -29,12 +31,119 @@ typedef void (*event_loop_render_callback)(GLFWwindow *, double);
 // basically just renders the UI
 void default_render_function(GLFWwindow *window, double dt);
 
+// Like default_render_function, but if the UI looks exactly like in the last
+// frame (same draw data), nothing is drawn or swapped, for apps that run
+// update every frame anyway. Don't use it if the app draws with GL itself
+// outside of ImGui draw callbacks.
+// It doesn't wait itself, after a skipped frame window_event_loop waits for
+// input until one refresh interval after the last frame.
+void skip_unchanged_render_function(GLFWwindow *window, double dt);
+
+// naming convention same as ImGui
+enum window_LoopFlags_
+{
+    window_LoopFlags_None = 0,
+    window_LoopFlags_Idle = 1 << 0, // block while nothing happens and only run frames (update and render)
+                                    // on input, resize, refresh or window_request_redraw, plus a few
+                                    // frames after, and for a short time while ImGui is busy (active
+                                    // items, text cursor, tooltip delays, ...). min_fps > 0 still
+                                    // wakes up at least every 1 / min_fps seconds.
+    window_LoopFlags_Pipelined = 1 << 1 // render on a thread of its own that owns the window's GL
+                                        // context, while the calling thread builds the next frame,
+                                        // see below.
+};
+
+typedef int window_LoopFlags;
+
 void window_event_loop(GLFWwindow *window
                      , event_loop_update_callback update
                      , event_loop_render_callback render = default_render_function
-                     , double min_fps = -1.0);
+                     , double min_fps = -1.0
+                     , window_LoopFlags flags = window_LoopFlags_None);
+
+// Pipelined loop
+// With window_LoopFlags_Pipelined, events, update and ImGui::Render run on
+// the calling thread, then the draw data is copied and render is called with
+// the copy on the render thread, while the calling thread goes on with the
+// next frame. The calling thread is at most one frame ahead, input shows up
+// one frame later than without it.
+// render runs on the render thread with the window's GL context and ImGui
+// context current (the current ImGui context is per thread, see
+// cmake/imgui_config.hpp). It must not call main thread only GLFW functions
+// or ImGui functions that build frames, the UI thread uses the same context.
+// default_render_function and skip_unchanged_render_function draw the copy.
+// Draw callbacks run on the render thread as well.
+// update runs with a hidden GL context current that shares objects
+// (textures, buffers, ...) with the window's, commands issued there are done
+// before the frame is drawn.
+// Falls back to rendering on the calling thread if the render thread or the
+// hidden context can't be created.
+
+// Multiple windows
+// Runs frames of all windows (each with its ImGui context current, see
+// imgui_init) until all of them are closed. update and render are called
+// with the window of the frame. Closed windows are hidden, imgui_exit and
+// window_destroy them after the loop.
+// Windows run one after another on the calling thread, with
+// window_LoopFlags_Pipelined every window gets a render thread, and a window
+// whose render thread still has its last frame is skipped instead of waited
+// for, so a slow window doesn't slow down the others.
+void window_event_loop(GLFWwindow **windows
+                     , int window_count
+                     , event_loop_update_callback update
+                     , event_loop_render_callback render = default_render_function
+                     , double min_fps = -1.0
+                     , window_LoopFlags flags = window_LoopFlags_None);
+
+// Frame stats
+// window_event_loop records the timings of the last WINDOW_FRAME_STATS_COUNT
+// frames of every window. The stages are only filled in by the render
+// functions of window-base, other render callbacks only get wait, update and
+// frame times. In a pipelined loop, render_seconds includes copying the draw
+// data, frame_seconds is the time of the calling thread (including waiting for
+// the render thread to take the last frame) and submit, swap and GPU times
+// come in once the render thread drew the frame.
+#define WINDOW_FRAME_STATS_COUNT 256
+
+struct window_frame_timing
+{
+    double wait_seconds;    // waiting for or polling events
+    double update_seconds;  // update callback
+    double render_seconds;  // ImGui::Render
+    double submit_seconds;  // GL calls of the backend, CPU side
+    double swap_seconds;    // glfwSwapBuffers incl. vsync, or waiting instead of it for skipped frames
+    double frame_seconds;   // whole frame, without wait_seconds
+    double gpu_seconds;     // GL_TIME_ELAPSED of the submitted commands, -1 if not (yet) known
+    bool skipped;           // skip_unchanged_render_function didn't draw
+};
+
+struct window_frame_stats
+{
+    window_frame_timing frames[WINDOW_FRAME_STATS_COUNT]; // oldest first
+    int frame_count;        // valid entries in frames
+    long long total_frames; // frames since the loop started
+    // of frame_seconds over frames
+    double frame_p50;
+    double frame_p90;
+    double frame_p99;
+    double frame_max;
+};
+
+// Returns false if there are no stats for window.
+bool window_get_frame_stats(GLFWwindow *window, window_frame_stats *out);
+
+// Runs at least frames more frames in the idle event loop, e.g. when something
+// the UI shows changed outside of input events. Wakes the loop up if it's
+// waiting. Main thread only, other threads can wake the loop with
+// glfwPostEmptyEvent.
+void window_request_redraw(GLFWwindow *window, int frames = 1);
 
 // UI
+// Every window gets its own ImGui context, which is current after
+// imgui_init, the event loops make the context of a window current for its
+// frames. All contexts share one font atlas, which is freed when the last
+// one exits. Contexts of later windows don't save imgui.ini (io.IniFilename
+// may be set).
 void imgui_init(GLFWwindow *window);
 void imgui_exit(GLFWwindow *window);
 
@@ -42,6 +151,12 @@ void imgui_new_frame();
 void imgui_end_frame();
 void imgui_set_next_window_full_size();
 
+// Small window in the top right corner of the viewport with the frame stats
+// of window (percentiles, average stage times and a graph of frame times).
+// Call between imgui_new_frame and the end of the frame.
+// Closes when the window is closed if open is not nullptr.
+void imgui_frame_stats_overlay(GLFWwindow *window, bool *open = nullptr);
+
 unsigned int imgui_hash(const char *str);
 void imgui_push_override_id(unsigned int id);
 void imgui_pop_id();